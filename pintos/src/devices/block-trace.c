@@ -0,0 +1,181 @@
+#include "devices/block-trace.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The ring of entries, and whether we are adding to it.  The
+   ring is protected by disabling interrupts, because requests
+   are submitted from many threads. */
+static struct block_trace_entry *ring;
+static size_t ring_size;        /* Capacity, in entries. */
+static size_t ring_next;        /* Where the next entry goes. */
+static size_t ring_cnt;         /* Entries in use. */
+static uint32_t dropped_cnt;    /* Entries overwritten. */
+static bool tracing;
+
+/* Devices seen so far, indexed by entries' DEVICE members. */
+static struct block *devices[BLOCK_TRACE_DEVICES];
+static size_t device_cnt;
+
+/* Starts tracing into a ring of ENTRY_CNT entries.  Panics if
+   the memory is not available. */
+void
+block_trace_init (size_t entry_cnt)
+{
+  size_t page_cnt = DIV_ROUND_UP (entry_cnt * sizeof *ring, PGSIZE);
+
+  ASSERT (entry_cnt > 0);
+  ring = palloc_get_multiple (0, page_cnt);
+  if (ring == NULL)
+    PANIC ("block trace: cannot allocate %zu pages for %zu entries",
+           page_cnt, entry_cnt);
+  ring_size = entry_cnt;
+  tracing = true;
+}
+
+/* Returns the index of BLOCK in the device table, adding it if
+   it is new, or UINT8_MAX if the table is full. */
+static uint8_t
+device_index (struct block *block)
+{
+  size_t i;
+
+  for (i = 0; i < device_cnt; i++)
+    if (devices[i] == block)
+      return i;
+  if (device_cnt >= BLOCK_TRACE_DEVICES)
+    return UINT8_MAX;
+  devices[device_cnt] = block;
+  return device_cnt++;
+}
+
+/* Records request R, which is being submitted to BLOCK, if
+   tracing is on. */
+void
+block_trace_record (struct block *block, const struct block_request *r)
+{
+  struct block_trace_entry *e;
+  enum intr_level old_level;
+
+  if (!tracing)
+    return;
+
+  old_level = intr_disable ();
+  if (!tracing)
+    {
+      /* Stopped since we checked. */
+      intr_set_level (old_level);
+      return;
+    }
+  e = &ring[ring_next];
+  e->tick = timer_ticks ();
+  e->sector = r->sector;
+  e->tid = thread_current ()->tid;
+  e->cnt = r->cnt;
+  e->device = device_index (block);
+  e->flags = ((r->write ? BLOCK_TRACE_WRITE : 0)
+              | (r->complete != NULL ? BLOCK_TRACE_ASYNC : 0));
+  ring_next = (ring_next + 1) % ring_size;
+  if (ring_cnt < ring_size)
+    ring_cnt++;
+  else
+    dropped_cnt++;
+  intr_set_level (old_level);
+}
+
+/* Stops tracing, so that the trace can be read.  Returns true
+   if tracing was on. */
+bool
+block_trace_stop (void)
+{
+  enum intr_level old_level;
+  bool was_tracing;
+
+  old_level = intr_disable ();
+  was_tracing = tracing;
+  tracing = false;
+  intr_set_level (old_level);
+  return was_tracing;
+}
+
+/* Returns the number of bytes in the trace, which must have been
+   stopped. */
+size_t
+block_trace_size (void)
+{
+  ASSERT (!tracing);
+  return BLOCK_SECTOR_SIZE + ring_cnt * sizeof *ring;
+}
+
+/* Fills in H, a BLOCK_SECTOR_SIZE-byte buffer, with the trace's
+   header. */
+static void
+make_header (struct block_trace_header *h)
+{
+  size_t i;
+
+  memset (h, 0, BLOCK_SECTOR_SIZE);
+  memcpy (h->magic, BLOCK_TRACE_MAGIC, sizeof h->magic);
+  h->version = BLOCK_TRACE_VERSION;
+  h->entry_size = sizeof *ring;
+  h->entry_cnt = ring_cnt;
+  h->dropped = dropped_cnt;
+  h->timer_freq = TIMER_FREQ;
+  h->device_cnt = device_cnt;
+  for (i = 0; i < device_cnt; i++)
+    strlcpy (h->devices[i], block_name (devices[i]), sizeof h->devices[i]);
+}
+
+/* Copies SIZE bytes starting at offset OFS in the trace, which
+   must have been stopped, into BUFFER. */
+void
+block_trace_read (size_t ofs, void *buffer_, size_t size)
+{
+  static union
+    {
+      struct block_trace_header h;
+      uint8_t bytes[BLOCK_SECTOR_SIZE];
+    }
+  header;
+  uint8_t *buffer = buffer_;
+  size_t oldest;
+
+  ASSERT (ring != NULL && !tracing);
+  ASSERT (ofs + size <= block_trace_size ());
+
+  oldest = (ring_next + ring_size - ring_cnt) % ring_size;
+
+  if (ofs < BLOCK_SECTOR_SIZE)
+    make_header (&header.h);
+  while (size > 0)
+    {
+      const uint8_t *src;
+      size_t chunk;
+
+      if (ofs < BLOCK_SECTOR_SIZE)
+        {
+          src = header.bytes + ofs;
+          chunk = BLOCK_SECTOR_SIZE - ofs;
+        }
+      else
+        {
+          size_t idx = (ofs - BLOCK_SECTOR_SIZE) / sizeof *ring;
+          size_t entry_ofs = (ofs - BLOCK_SECTOR_SIZE) % sizeof *ring;
+
+          src = ((const uint8_t *) &ring[(oldest + idx) % ring_size]
+                 + entry_ofs);
+          chunk = sizeof *ring - entry_ofs;
+        }
+      if (chunk > size)
+        chunk = size;
+      memcpy (buffer, src, chunk);
+      buffer += chunk;
+      ofs += chunk;
+      size -= chunk;
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef DEVICES_BLOCK_TRACE_H
+#define DEVICES_BLOCK_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+/* Block I/O tracing.
+
+   When enabled, every request submitted to a block device is
+   recorded in a fixed-size ring, which keeps the most recent
+   ones.  The ring can be read back as a byte stream, which
+   fsutil_append_trace() copies to the scratch device at
+   shutdown and utils/pintos-iotrace decodes.
+
+   The stream starts with a BLOCK_SECTOR_SIZE-byte header,
+   struct block_trace_header, followed by the entries in the
+   order they were recorded, oldest first.  Both are in the
+   machine's byte order, which is little-endian. */
+
+#define BLOCK_TRACE_MAGIC "PINTRACE"
+#define BLOCK_TRACE_VERSION 1
+
+/* Most devices that a trace can name. */
+#define BLOCK_TRACE_DEVICES 24
+
+struct block_trace_header
+  {
+    char magic[8];                      /* BLOCK_TRACE_MAGIC. */
+    uint32_t version;                   /* BLOCK_TRACE_VERSION. */
+    uint32_t entry_size;                /* sizeof (struct block_trace_entry). */
+    uint32_t entry_cnt;                 /* Entries that follow. */
+    uint32_t dropped;                   /* Older entries overwritten. */
+    uint32_t timer_freq;                /* Timer ticks per second. */
+    uint32_t device_cnt;                /* Devices named below. */
+    char devices[BLOCK_TRACE_DEVICES][16]; /* Names, by entry DEVICE. */
+  };
+
+/* Entry flags. */
+#define BLOCK_TRACE_WRITE 0x01          /* Write, not read. */
+#define BLOCK_TRACE_ASYNC 0x02          /* Submitter did not wait. */
+
+/* One request. */
+struct block_trace_entry
+  {
+    uint32_t tick;                      /* Timer tick of submission. */
+    block_sector_t sector;              /* First sector, on DEVICE. */
+    int32_t tid;                        /* Submitting thread. */
+    uint16_t cnt;                       /* Number of sectors. */
+    uint8_t device;                     /* Index into header's DEVICES. */
+    uint8_t flags;                      /* BLOCK_TRACE_* flags. */
+  };
+
+void block_trace_init (size_t entry_cnt);
+void block_trace_record (struct block *, const struct block_request *);
+bool block_trace_stop (void);
+size_t block_trace_size (void);
+void block_trace_read (size_t ofs, void *buffer, size_t size);
+
+#endif /* devices/block-trace.h */
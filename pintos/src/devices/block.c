@@ -1,9 +1,55 @@
 #include "devices/block.h"
+#include <block-stats.h>
 #include <list.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/block-trace.h"
 #include "devices/ide.h"
+#include "devices/partition.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "filesys/cache.h"
+#endif
+
+/* I/O schedulers, which choose the order in which a device's
+   queued requests go to its driver. */
+enum block_sched
+  {
+    BLOCK_SCHED_FIFO,           /* Arrival order. */
+    BLOCK_SCHED_CSCAN,          /* Ascending sectors, then wrap around. */
+    BLOCK_SCHED_DEADLINE        /* C-SCAN, but serve expired requests first. */
+  };
+
+static enum block_sched block_sched = BLOCK_SCHED_DEADLINE;
+
+/* Timer ticks that a read or a write may wait in a queue before
+   the deadline scheduler serves it ahead of its C-SCAN turn.
+   Reads get the shorter deadline because a thread is usually
+   waiting for them. */
+#define READ_EXPIRE (TIMER_FREQ / 4)
+#define WRITE_EXPIRE (TIMER_FREQ * 5 / 2)
+
+/* A device's queue of pending requests. */
+struct block_queue
+  {
+    struct lock lock;                   /* Protects the members below. */
+    struct condition nonempty;          /* Signaled when a request arrives. */
+    struct list sorted;                 /* Requests in sector order. */
+    struct list fifo;                   /* Requests in arrival order. */
+    bool started;                       /* I/O thread created? */
+    block_sector_t head;                /* Sector after last one dispatched. */
+
+    unsigned long long dispatch_cnt;    /* Requests passed to the driver. */
+    unsigned long long merge_cnt;       /* Requests merged into others. */
+
+    /* Used only by the I/O thread. */
+    struct block_request *batch[BLOCK_MAX_RUN]; /* Merged requests. */
+    void *buffers[BLOCK_MAX_RUN];       /* Their buffers, one per sector. */
+  };
 
 /* A block device. */
 struct block
@@ -16,9 +62,25 @@ struct block
 
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
+    struct block_queue *queue;          /* Null if OPS->map or submit is. */
 
     unsigned long long read_cnt;        /* Number of sectors read. */
+    unsigned long long read_req_cnt;    /* Number of read requests. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+    unsigned long long write_req_cnt;   /* Number of write requests. */
+
+    /* Timing, in TSC cycles.  Requests complete in drivers' and
+       I/O threads, so these are protected by disabling
+       interrupts. */
+    uint64_t register_cycles;           /* When registered. */
+    int64_t register_ticks;             /* The same, in timer ticks. */
+    unsigned pending;                   /* Requests outstanding. */
+    uint64_t pending_stamp;             /* Last change to PENDING. */
+    uint64_t busy_cycles;               /* Time with PENDING > 0. */
+    uint64_t depth_cycles;              /* Sum over time of PENDING. */
+    uint64_t latency_cycles;            /* Total latency of completions. */
+    uint64_t read_latency[BLOCK_STATS_BUCKETS];  /* Log2 histograms. */
+    uint64_t write_latency[BLOCK_STATS_BUCKETS];
   };
 
 /* List of all block devices. */
@@ -28,6 +90,10 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_io (struct block *, bool write, block_sector_t,
+                      void *buffer, size_t cnt);
+static void io_thread (void *block_);
+static uint64_t account_pending (struct block_request *, int delta);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -65,12 +131,25 @@ block_set_role (enum block_type role, struct block *block)
   block_by_role[role] = block;
 }
 
+/* Returns BLOCK, after reading its partition table if its
+   driver deferred that until now, so that its partitions follow
+   it in the list.  BLOCK may be null. */
+static struct block *
+block_found (struct block *block)
+{
+  if (block != NULL)
+    partition_scan_if_deferred (block);
+  return block;
+}
+
 /* Returns the first block device in kernel probe order, or a
-   null pointer if no block devices are registered. */
+   null pointer if no block devices are registered.  Partitions
+   are registered as iteration reaches the devices they are on,
+   so they come after all the devices probed at boot. */
 struct block *
 block_first (void)
 {
-  return list_elem_to_block (list_begin (&all_blocks));
+  return block_found (list_elem_to_block (list_begin (&all_blocks)));
 }
 
 /* Returns the block device following BLOCK in kernel probe
@@ -78,11 +157,13 @@ block_first (void)
 struct block *
 block_next (struct block *block)
 {
-  return list_elem_to_block (list_next (&block->list_elem));
+  return block_found (list_elem_to_block (list_next (&block->list_elem)));
 }
 
 /* Returns the block device with the given NAME, or a null
-   pointer if no block device has that name. */
+   pointer if no block device has that name.  Partitions are
+   named after the device they are on, so only a device whose
+   name begins NAME has its partition table read. */
 struct block *
 block_get_by_name (const char *name)
 {
@@ -94,6 +175,9 @@ block_get_by_name (const char *name)
       struct block *block = list_entry (e, struct block, list_elem);
       if (!strcmp (name, block->name))
         return block;
+      if (strlen (name) > strlen (block->name)
+          && !memcmp (name, block->name, strlen (block->name)))
+        partition_scan_if_deferred (block);
     }
 
   return NULL;
@@ -120,9 +204,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_io (block, false, sector, buffer, 1);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +215,374 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_io (block, true, sector, (void *) buffer, 1);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for CNT *
+   BLOCK_SECTOR_SIZE bytes.  If the driver supports it, each run
+   of up to BLOCK_MAX_RUN sectors is a single request.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  for (i = 0; i < cnt; i += BLOCK_MAX_RUN)
+    block_io (block, false, sector + i, buffer + i * BLOCK_SECTOR_SIZE,
+              cnt - i < BLOCK_MAX_RUN ? cnt - i : BLOCK_MAX_RUN);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   If the driver supports it, each run of up to BLOCK_MAX_RUN
+   sectors is a single request.  Returns after the block device
+   has acknowledged receiving all the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = (uint8_t *) buffer_;
+  size_t i;
+
+  for (i = 0; i < cnt; i += BLOCK_MAX_RUN)
+    block_io (block, true, sector + i, buffer + i * BLOCK_SECTOR_SIZE,
+              cnt - i < BLOCK_MAX_RUN ? cnt - i : BLOCK_MAX_RUN);
+}
+
+/* Submits a request to BLOCK and waits for it to complete. */
+static void
+block_io (struct block *block, bool write, block_sector_t sector,
+          void *buffer, size_t cnt)
+{
+  struct block_request r;
+
+  r.write = write;
+  r.sector = sector;
+  r.cnt = cnt;
+  r.buffer = buffer;
+  r.buffers = NULL;
+  r.complete = NULL;
+  r.aux = NULL;
+  block_submit (block, &r);
+  block_wait (&r);
+}
+
+/* Returns true if each of the CNT BUFFERS is in kernel memory. */
+static bool
+buffers_in_kernel (void *const *buffers, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    if (!is_kernel_vaddr (buffers[i]))
+      return false;
+  return true;
+}
+
+/* Queues request R for BLOCK and returns without waiting for it
+   to complete.  See the comment on struct block_request for the
+   rules. */
+void
+block_submit (struct block *block, struct block_request *r)
+{
+  struct block_queue *q;
+  struct list_elem *e;
+
+  ASSERT (r->cnt >= 1 && r->cnt <= BLOCK_MAX_RUN);
+  ASSERT ((r->buffer != NULL) != (r->buffers != NULL));
+  ASSERT (r->buffer == NULL || is_kernel_vaddr (r->buffer));
+  ASSERT (r->buffers == NULL || buffers_in_kernel (r->buffers, r->cnt));
+  block_trace_record (block, r);
+  r->block = block;
+  r->first = r->sector;
+
+  /* Account for the request at each level, so that a partition
+     and the disk it is on both see it. */
+  for (;;)
+    {
+      check_sector (block, r->sector);
+      check_sector (block, r->sector + r->cnt - 1);
+      if (r->write)
+        {
+          ASSERT (block->type != BLOCK_FOREIGN);
+          block->write_cnt += r->cnt;
+          block->write_req_cnt++;
+        }
+      else
+        {
+          block->read_cnt += r->cnt;
+          block->read_req_cnt++;
+        }
+      if (block->ops->map == NULL)
+        break;
+      block = block->ops->map (block->aux, &r->sector);
+    }
+
+  r->start = account_pending (r, 1);
+  sema_init (&r->done, 0);
+  if (block->ops->submit != NULL)
+    {
+      block->ops->submit (block->aux, r);
+      return;
+    }
+  r->deadline = timer_ticks () + (r->write ? WRITE_EXPIRE : READ_EXPIRE);
+
+  q = block->queue;
+  lock_acquire (&q->lock);
+  if (!q->started)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "%.12s-io", block->name);
+      if (thread_create (name, PRI_DEFAULT, io_thread, block) == TID_ERROR)
+        PANIC ("%s: cannot create I/O thread", block->name);
+      q->started = true;
+    }
+  for (e = list_begin (&q->sorted); e != list_end (&q->sorted);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, sorted_elem)->sector > r->sector)
+      break;
+  list_insert (e, &r->sorted_elem);
+  list_push_back (&q->fifo, &r->fifo_elem);
+  cond_signal (&q->nonempty, &q->lock);
+  lock_release (&q->lock);
+}
+
+/* Waits for R, which must have been submitted, to complete. */
+void
+block_wait (struct block_request *r)
+{
+  sema_down (&r->done);
+}
+
+/* Marks R complete: calls its completion function, if any, and
+   wakes up block_wait().  R may be freed as soon as this
+   happens, so the caller must not touch it afterward.  Called by
+   the block layer, and by drivers that handle their own
+   requests. */
+void
+block_complete (struct block_request *r)
+{
+  if (r->block != NULL)
+    account_pending (r, -1);
+  if (r->complete != NULL)
+    r->complete (r);
+  sema_up (&r->done);
+}
+
+/* Selects the I/O scheduler NAME, which must be "fifo",
+   "cscan", or "deadline".  Returns false if NAME is none of
+   these. */
+bool
+block_set_scheduler (const char *name)
+{
+  if (!strcmp (name, "fifo"))
+    block_sched = BLOCK_SCHED_FIFO;
+  else if (!strcmp (name, "cscan"))
+    block_sched = BLOCK_SCHED_CSCAN;
+  else if (!strcmp (name, "deadline"))
+    block_sched = BLOCK_SCHED_DEADLINE;
+  else
+    return false;
+  return true;
+}
+
+/* Returns the request in nonempty queue Q that the I/O
+   scheduler wants served next. */
+static struct block_request *
+pick_request (struct block_queue *q)
+{
+  struct block_request *oldest;
+  struct list_elem *e;
+
+  oldest = list_entry (list_front (&q->fifo), struct block_request, fifo_elem);
+  if (block_sched == BLOCK_SCHED_FIFO
+      || (block_sched == BLOCK_SCHED_DEADLINE
+          && timer_ticks () >= oldest->deadline))
+    return oldest;
+
+  /* C-SCAN: the lowest sector at or past the head, or if there
+     is none, the lowest sector of all. */
+  for (e = list_begin (&q->sorted); e != list_end (&q->sorted);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sorted_elem);
+      if (r->sector >= q->head)
+        return r;
+    }
+  return list_entry (list_front (&q->sorted), struct block_request,
+                     sorted_elem);
+}
+
+/* Removes FIRST from Q, along with the requests in the same
+   direction that, together with it, cover a run of consecutive
+   sectors no longer than BLOCK_MAX_RUN.  Stores them in
+   Q->batch in sector order and returns how many there are. */
+static size_t
+take_requests (struct block_queue *q, struct block_request *first)
+{
+  struct list_elem *e = &first->sorted_elem;
+  block_sector_t next = first->sector;
+  size_t sector_cnt = first->cnt;
+  size_t req_cnt = 0;
+
+  /* Back up to the start of the run. */
+  while (e != list_begin (&q->sorted))
+    {
+      struct block_request *r = list_entry (list_prev (e),
+                                            struct block_request,
+                                            sorted_elem);
+      if (r->write != first->write || r->sector + r->cnt != next
+          || sector_cnt + r->cnt > BLOCK_MAX_RUN)
+        break;
+      next = r->sector;
+      sector_cnt += r->cnt;
+      e = list_prev (e);
+    }
+
+  /* Take requests from there forward. */
+  sector_cnt = 0;
+  while (e != list_end (&q->sorted))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sorted_elem);
+      if (r->write != first->write || r->sector != next
+          || sector_cnt + r->cnt > BLOCK_MAX_RUN)
+        break;
+      q->batch[req_cnt++] = r;
+      next += r->cnt;
+      sector_cnt += r->cnt;
+      e = list_remove (e);
+      list_remove (&r->fifo_elem);
+    }
+  ASSERT (req_cnt > 0);
+  return req_cnt;
+}
+
+/* Passes the REQ_CNT requests in BLOCK's queue's batch to the
+   driver as one request. */
+static void
+dispatch (struct block *block, size_t req_cnt)
+{
+  struct block_queue *q = block->queue;
+  const struct block_operations *ops = block->ops;
+  block_sector_t sector = q->batch[0]->sector;
+  bool write = q->batch[0]->write;
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i < req_cnt; i++)
+    {
+      struct block_request *r = q->batch[i];
+      for (j = 0; j < r->cnt; j++)
+        q->buffers[cnt++] = (r->buffers != NULL
+                             ? r->buffers[j]
+                             : (uint8_t *) r->buffer + j * BLOCK_SECTOR_SIZE);
+    }
+
+  if (write && ops->writev != NULL)
+    ops->writev (block->aux, sector, (const void *const *) q->buffers, cnt);
+  else if (!write && ops->readv != NULL)
+    ops->readv (block->aux, sector, q->buffers, cnt);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        ops->write (block->aux, sector + i, q->buffers[i]);
+      else
+        ops->read (block->aux, sector + i, q->buffers[i]);
+}
+
+/* Thread function that serves the queue of BLOCK_, forever. */
+static void
+io_thread (void *block_)
+{
+  struct block *block = block_;
+  struct block_queue *q = block->queue;
+
+  for (;;)
+    {
+      struct block_request *last;
+      size_t req_cnt, i;
+
+      lock_acquire (&q->lock);
+      while (list_empty (&q->fifo))
+        cond_wait (&q->nonempty, &q->lock);
+      req_cnt = take_requests (q, pick_request (q));
+      last = q->batch[req_cnt - 1];
+      q->head = last->sector + last->cnt;
+      q->dispatch_cnt++;
+      q->merge_cnt += req_cnt - 1;
+      lock_release (&q->lock);
+
+      dispatch (block, req_cnt);
+
+      for (i = 0; i < req_cnt; i++)
+        block_complete (q->batch[i]);
+    }
+}
+
+/* Returns the histogram bucket for a latency of CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (cycles > 1 && bucket < BLOCK_STATS_BUCKETS - 1)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Accounts for request R arriving at (DELTA = 1) or leaving
+   (DELTA = -1) the device it was submitted to and each device
+   that one maps onto, and returns the time.  A request leaving
+   adds its latency to the histograms. */
+static uint64_t
+account_pending (struct block_request *r, int delta)
+{
+  struct block *block = r->block;
+  block_sector_t sector = r->first;
+  enum intr_level old_level;
+  uint64_t now;
+
+  old_level = intr_disable ();
+  now = timer_cycles ();
+  for (;;)
+    {
+      uint64_t span = now - block->pending_stamp;
+
+      if (block->pending > 0)
+        {
+          block->busy_cycles += span;
+          block->depth_cycles += span * block->pending;
+        }
+      block->pending_stamp = now;
+      block->pending += delta;
+      if (delta < 0)
+        {
+          uint64_t *histogram = (r->write
+                                 ? block->write_latency
+                                 : block->read_latency);
+          histogram[latency_bucket (now - r->start)]++;
+          block->latency_cycles += now - r->start;
+        }
+
+      if (block->ops->map == NULL)
+        break;
+      block = block->ops->map (block->aux, &sector);
+    }
+  intr_set_level (old_level);
+
+  return now;
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -176,10 +622,105 @@ get_block_writes (enum block_type block_role)
   return block->write_cnt;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Fills in the members of STATS that fit in STATS->size bytes
+   with BLOCK's statistics, then sets STATS->version and
+   STATS->size to match. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  struct block_stats s;
+  enum intr_level old_level;
+  uint64_t now;
+
+  s.version = BLOCK_STATS_VERSION;
+  s.size = stats->size < sizeof s ? stats->size : sizeof s;
+  strlcpy (s.name, block->name, sizeof s.name);
+  s.reads = block->read_cnt;
+  s.read_requests = block->read_req_cnt;
+  s.writes = block->write_cnt;
+  s.write_requests = block->write_req_cnt;
+  s.elapsed_ms = ((timer_ticks () - block->register_ticks) * 1000
+                  / TIMER_FREQ);
+
+  old_level = intr_disable ();
+  now = timer_cycles ();
+  s.elapsed_cycles = now - block->register_cycles;
+  s.busy_cycles = block->busy_cycles;
+  s.depth_cycles = block->depth_cycles;
+  if (block->pending > 0)
+    {
+      /* Include the time since the last change. */
+      s.busy_cycles += now - block->pending_stamp;
+      s.depth_cycles += (now - block->pending_stamp) * block->pending;
+    }
+  s.latency_cycles = block->latency_cycles;
+  memcpy (s.read_latency, block->read_latency, sizeof s.read_latency);
+  memcpy (s.write_latency, block->write_latency, sizeof s.write_latency);
+  intr_set_level (old_level);
+
+  memcpy (stats, &s, s.size);
+}
+
+/* Prints BLOCK's latency HISTOGRAM for KIND of requests, if it
+   is not empty, on one line. */
+static void
+print_histogram (struct block *block, const char *kind,
+                 const uint64_t histogram[BLOCK_STATS_BUCKETS])
+{
+  int i;
+
+  for (i = 0; i < BLOCK_STATS_BUCKETS; i++)
+    if (histogram[i] != 0)
+      break;
+  if (i >= BLOCK_STATS_BUCKETS)
+    return;
+
+  printf ("%s: %s latency by log2(cycles):", block->name, kind);
+  for (; i < BLOCK_STATS_BUCKETS; i++)
+    if (histogram[i] != 0)
+      printf (" %d:%"PRIu64, i, histogram[i]);
+  printf ("\n");
+}
+
+/* Prints BLOCK's timing statistics, if it has done any I/O. */
+static void
+print_timing (struct block *block)
+{
+  struct block_stats s;
+  uint64_t done, cycles_per_us;
+  int i;
+
+  s.size = sizeof s;
+  block_get_stats (block, &s);
+  done = 0;
+  for (i = 0; i < BLOCK_STATS_BUCKETS; i++)
+    done += s.read_latency[i] + s.write_latency[i];
+  if (done == 0 || s.elapsed_cycles == 0)
+    return;
+
+  /* Estimate the TSC's frequency from the timer. */
+  cycles_per_us = (s.elapsed_ms > 0
+                   ? s.elapsed_cycles / (s.elapsed_ms * 1000) : 0);
+  if (cycles_per_us == 0)
+    cycles_per_us = 1;
+
+  printf ("%s: %"PRIu64" requests, %"PRIu64" us mean latency, "
+          "busy %"PRIu64"%% of %"PRIu64" ms, "
+          "queue depth %"PRIu64".%02"PRIu64" mean\n",
+          block->name, done, s.latency_cycles / done / cycles_per_us,
+          s.busy_cycles * 100 / s.elapsed_cycles, s.elapsed_ms,
+          s.depth_cycles / s.elapsed_cycles,
+          s.depth_cycles % s.elapsed_cycles * 100 / s.elapsed_cycles);
+  print_histogram (block, "read", s.read_latency);
+  print_histogram (block, "write", s.write_latency);
+}
+
+/* Prints statistics for each block device used for a Pintos
+   role, and timing statistics for every device that did I/O. */
 void
 block_print_stats (void)
 {
+  struct list_elem *e;
   int i;
 
   for (i = 0; i < BLOCK_ROLE_CNT; i++)
@@ -187,11 +728,26 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          printf ("%s (%s): %llu reads in %llu requests, "
+                  "%llu writes in %llu requests\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  block->read_cnt, block->read_req_cnt,
+                  block->write_cnt, block->write_req_cnt);
         }
     }
+  for (e = list_begin (&all_blocks); e != list_end (&all_blocks);
+       e = list_next (e))
+    {
+      struct block *block = list_entry (e, struct block, list_elem);
+      if (block->queue != NULL && block->queue->dispatch_cnt > 0)
+        printf ("%s: %llu requests dispatched, %llu merged\n",
+                block->name, block->queue->dispatch_cnt,
+                block->queue->merge_cnt);
+      print_timing (block);
+    }
+#ifdef FILESYS
+  cache_print_stats ();
+#endif
 }
 
 /* Registers a new block device with the given NAME.  If
@@ -215,7 +771,32 @@ block_register (const char *name, enum block_type type,
   block->ops = ops;
   block->aux = aux;
   block->read_cnt = 0;
+  block->read_req_cnt = 0;
   block->write_cnt = 0;
+  block->write_req_cnt = 0;
+  block->register_cycles = block->pending_stamp = timer_cycles ();
+  block->register_ticks = timer_ticks ();
+  block->pending = 0;
+  block->busy_cycles = 0;
+  block->depth_cycles = 0;
+  block->latency_cycles = 0;
+  memset (block->read_latency, 0, sizeof block->read_latency);
+  memset (block->write_latency, 0, sizeof block->write_latency);
+  block->queue = NULL;
+  if (ops->map == NULL && ops->submit == NULL)
+    {
+      struct block_queue *q = block->queue = malloc (sizeof *q);
+      if (q == NULL)
+        PANIC ("Failed to allocate memory for block device queue");
+      lock_init (&q->lock);
+      cond_init (&q->nonempty);
+      list_init (&q->sorted);
+      list_init (&q->fifo);
+      q->started = false;
+      q->head = 0;
+      q->dispatch_cnt = 0;
+      q->merge_cnt = 0;
+    }
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,11 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <list.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -54,6 +57,9 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, void *, size_t cnt);
+void block_write_multiple (struct block *, block_sector_t, const void *,
+                           size_t cnt);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
@@ -61,16 +67,96 @@ int get_block_reads (enum block_type);
 int get_block_writes (enum block_type);
 
 /* Statistics. */
+struct block_stats;
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
-
+
+/* Most sectors in one request, and in one request to a driver
+   after merging.  Longer runs are split. */
+#define BLOCK_MAX_RUN 256
+
+/* Asynchronous requests.
+
+   Each device has a queue of pending requests.  A kernel thread
+   per device passes them to the driver in the order chosen by
+   the I/O scheduler, merging requests for adjacent sectors.  The
+   synchronous functions above submit a request and wait for it.
+
+   The submitter fills in the members of struct block_request up
+   to AUX, calls block_submit(), and must then leave the request
+   and its buffers alone until it completes.  On completion the
+   block layer calls COMPLETE, if non-null, then wakes up
+   block_wait().  COMPLETE usually runs in a device's I/O
+   thread, but for a device such as a RAM disk it may run in the
+   submitter's thread before block_submit() returns.
+
+   Buffers must be in kernel memory.  The driver usually reads or
+   writes them from the I/O thread, which cannot see the
+   submitter's user address space, and a DMA driver needs their
+   physical addresses.  Data bound for user memory must go
+   through a kernel buffer, as cache_read_multiple() does.
+
+   A driver that makes up requests of its own and passes them to
+   its own submit function, rather than to block_submit(), must
+   set their BLOCK to null, so that they are not counted. */
+struct block_request
+  {
+    bool write;                 /* Write (true) or read (false)? */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Sectors, 1 to BLOCK_MAX_RUN. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes, or... */
+    void *const *buffers;       /* ...a BLOCK_SECTOR_SIZE buffer per sector. */
+    void (*complete) (struct block_request *);
+    void *aux;                  /* For COMPLETE's use. */
+
+    /* Owned by the block layer. */
+    struct list_elem sorted_elem;       /* In queue, by sector. */
+    struct list_elem fifo_elem;         /* In queue, by arrival. */
+    int64_t deadline;                   /* Tick to dispatch it by. */
+    struct block *block;                /* Device submitted to. */
+    block_sector_t first;               /* SECTOR, as submitted. */
+    uint64_t start;                     /* TSC at submission. */
+    struct semaphore done;              /* Up'd on completion. */
+  };
+
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+bool block_set_scheduler (const char *name);
+
 /* Lower-level interface to block device drivers. */
 
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Read or write CNT consecutive sectors starting at the given
+       one, into or from the BLOCK_SECTOR_SIZE-byte BUFFERS, as
+       one request.  Optional: if null, the block layer calls
+       read() or write() once per sector instead. */
+    void (*readv) (void *aux, block_sector_t,
+                   void *const buffers[], size_t cnt);
+    void (*writev) (void *aux, block_sector_t,
+                    const void *const buffers[], size_t cnt);
+
+    /* For a device that is a window onto part of another, such
+       as a partition: returns the other device and adjusts
+       *SECTOR to the corresponding sector there.  Requests then
+       join the other device's queue and the members above are
+       never called.  Null for other devices. */
+    struct block *(*map) (void *aux, block_sector_t *sector);
+
+    /* For a device that passes requests on to other devices
+       itself, such as a RAID array: takes over request R, which
+       has been checked and counted, and must eventually call
+       block_complete() on it.  The device then has no queue of
+       its own, and the members above other than MAP are never
+       called.  Null for other devices. */
+    void (*submit) (void *aux, struct block_request *r);
   };
 
+void block_complete (struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
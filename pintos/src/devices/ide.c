@@ -1,17 +1,30 @@
 #include "devices/ide.h"
 #include <ctype.h>
 #include <debug.h>
+#include <inttypes.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If a PCI
+   bus-master IDE controller is present, such as the Intel PIIX
+   that QEMU emulates, transfers use DMA [BMIDE]; otherwise they
+   use PIO. */
+
+/* Use bus-master DMA if possible?  Cleared by the -no-dma kernel
+   option. */
+bool ide_use_dma = true;
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +43,36 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
+/* Bus master Command Register bits. */
+#define BM_START 0x01           /* Start transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Disk interrupted (write 1 to clear). */
+
+/* A physical region descriptor, one piece of memory for a DMA
+   transfer.  A region may not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address, even. */
+    uint16_t size;              /* Size in bytes, even; 0 means 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT (PGSIZE / sizeof (struct prd))
+#define PRD_BOUNDARY 0x10000
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +88,11 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +101,18 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt with READ/WRITE
+                                   MULTIPLE, or 0 if not supported. */
+    bool dma;                   /* Transfer with bus-master DMA? */
+
+    /* Sectors transferred each way, [0] for reads and [1] for
+       writes, protected by the channel's lock. */
+    unsigned long long dma_cnt[2];      /* By bus-master DMA. */
+    unsigned long long pio_cnt[2];      /* By PIO. */
+
+    /* Found by probing, for registration afterward. */
+    block_sector_t capacity;    /* Size in sectors. */
+    char info[128];             /* Model and serial number. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +128,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master I/O port base, 0 if none. */
+    struct prd *prdt;           /* PRD table, in its own page. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,25 +143,43 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int);
+static uint16_t find_bus_master (void);
+static thread_func probe_channel;
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
+static int poll_backoff (int);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+/* Signaled by each channel's probe thread when it finishes. */
+static struct semaphore probe_done;
+
+/* Initialize the disk subsystem and detect disks.
+
+   Resetting a channel and waiting for its devices takes most of
+   the time here, so each channel is probed by a thread of its
+   own, in parallel with the other.  The disks found are
+   registered afterward, in channel order, so that the probe
+   order that the rest of the kernel sees does not depend on
+   which thread finishes first. */
 void
 ide_init (void)
 {
+  uint16_t bm_base = ide_use_dma ? find_bus_master () : 0;
+  int64_t start = timer_ticks ();
   size_t chan_no;
 
+  sema_init (&probe_done, 0);
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -127,6 +204,10 @@ ide_init (void)
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
 
+      /* Each channel has 8 bus master registers. */
+      c->bm_base = bm_base != 0 ? bm_base + chan_no * 8 : 0;
+      c->prdt = c->bm_base != 0 ? palloc_get_page (PAL_ASSERT) : NULL;
+
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         {
@@ -136,25 +217,121 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
+          d->dma_cnt[0] = d->dma_cnt[1] = 0;
+          d->pio_cnt[0] = d->pio_cnt[1] = 0;
         }
 
       /* Register interrupt handler. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
+    }
 
-      /* Reset hardware. */
-      reset_channel (c);
+  /* Probe the channels in parallel. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      char name[16];
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+      snprintf (name, sizeof name, "ide%zu-probe", chan_no);
+      if (thread_create (name, PRI_DEFAULT, probe_channel, c) == TID_ERROR)
+        probe_channel (c);
+    }
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    sema_down (&probe_done);
+
+  /* Register the disks found.  Their partition tables are read
+     when a device is first looked up. */
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
 
-      /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
-        if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+        {
+          struct ata_disk *d = &c->devices[dev_no];
+          if (d->is_ata)
+            partition_defer (block_register (d->name, BLOCK_RAW, d->info,
+                                             d->capacity, &ide_operations,
+                                             d));
+        }
     }
+
+  /* Report the time taken.  The probe threads share the CPU and
+     busy-wait for short delays, so their individual times do not
+     add up to what a serial probe would take; compare with the
+     boot log of a kernel that probes serially instead. */
+  printf ("ide: probed %d channels in %"PRId64" ms\n",
+          CHANNEL_CNT, timer_elapsed (start) * 1000 / TIMER_FREQ);
+}
+
+/* Prints how many sectors each disk that did I/O transferred
+   with DMA and with PIO. */
+void
+ide_print_stats (void)
+{
+  size_t chan_no;
+  int dev_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    for (dev_no = 0; dev_no < 2; dev_no++)
+      {
+        struct ata_disk *d = &channels[chan_no].devices[dev_no];
+        if (d->dma_cnt[0] + d->dma_cnt[1] + d->pio_cnt[0] + d->pio_cnt[1] > 0)
+          printf ("%s: %llu sectors read and %llu written by DMA, "
+                  "%llu read and %llu written by PIO\n",
+                  d->name, d->dma_cnt[0], d->dma_cnt[1],
+                  d->pio_cnt[0], d->pio_cnt[1]);
+      }
+}
+
+/* Thread function that resets channel C_ and identifies the
+   disks on it. */
+static void
+probe_channel (void *c_)
+{
+  struct channel *c = c_;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device (&c->devices[dev_no]);
+
+  sema_up (&probe_done);
 }
 
+/* Looks for a PCI bus-master IDE controller and enables it.
+   Returns the I/O port base of its bus master registers, or 0 if
+   there is none. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_device pci;
+  uint16_t bm_base;
+
+  /* Bit 7 of the programming interface says whether the
+     controller can be a bus master. */
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &pci)
+      || (pci.prog_if & 0x80) == 0)
+    return 0;
+  bm_base = pci_io_bar (&pci, 4);
+  if (bm_base == 0)
+    return 0;
+
+  pci_enable (&pci, PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+  printf ("ide: bus-master DMA at port %#x (PCI %02x:%02x.%x)\n",
+          bm_base, pci.bus, pci.dev, pci.func);
+  return bm_base;
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
@@ -188,6 +365,10 @@ reset_channel (struct channel *c)
                          && inb (reg_lbal (c)) == 0xaa);
     }
 
+  /* An empty channel has nothing to wait for. */
+  if (!present[0] && !present[1])
+    return;
+
   /* Issue soft reset sequence, which selects device 0 as a side effect.
      Also enable interrupts. */
   outb (reg_ctl (c), 0);
@@ -196,7 +377,9 @@ reset_channel (struct channel *c)
   timer_usleep (10);
   outb (reg_ctl (c), 0);
 
-  timer_msleep (150);
+  /* [ATA-3] requires 2 ms before BSY is meaningful.  After that
+     we poll, rather than sleeping for the worst case. */
+  timer_msleep (2);
 
   /* Wait for device 0 to clear BSY. */
   if (present[0])
@@ -208,14 +391,15 @@ reset_channel (struct channel *c)
   /* Wait for device 1 to clear BSY. */
   if (present[1])
     {
+      int64_t waited = 0;
       int i;
 
       select_device (&c->devices[1]);
-      for (i = 0; i < 3000; i++)
+      for (i = 0; waited < 30 * 1000 * 1000; i++)
         {
           if (inb (reg_nsect (c)) == 1 && inb (reg_lbal (c)) == 1)
             break;
-          timer_msleep (10);
+          waited += poll_backoff (i);
         }
       wait_while_busy (&c->devices[1]);
     }
@@ -263,8 +447,6 @@ identify_ata_device (struct ata_disk *d)
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
   char *model, *serial;
-  char extra_info[128];
-  struct block *block;
 
   ASSERT (d->is_ata);
 
@@ -286,7 +468,7 @@ identify_ata_device (struct ata_disk *d)
   capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
-  snprintf (extra_info, sizeof extra_info,
+  snprintf (d->info, sizeof d->info,
             "model \"%s\", serial \"%s\"", model, serial);
 
   /* Disable access to IDE disks over 1 GB, which are likely
@@ -303,10 +485,37 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
-  /* Register. */
-  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
-                          &ide_operations, d);
-  partition_scan (block);
+  /* Move as many sectors per interrupt as the disk allows.  The
+     low byte of word 47 is the most sectors per DRQ block that
+     READ MULTIPLE and WRITE MULTIPLE support, or 0 if they are
+     not supported at all. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Bit 8 of word 49 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+
+  d->capacity = capacity;
+}
+
+/* Sends a SET MULTIPLE MODE command to disk D to transfer CNT
+   sectors per interrupt, and records the result in D.  CNT of 0
+   leaves READ MULTIPLE and WRITE MULTIPLE unused. */
+static void
+set_multiple_mode (struct ata_disk *d, int cnt)
+{
+  struct channel *c = d->channel;
+
+  d->multiple = 0;
+  if (cnt == 0)
+    return;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
 }
 
 /* Translates STRING, which consists of SIZE bytes in a funky
@@ -337,63 +546,231 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* The memory for a multi-sector transfer: either one contiguous
+   BUFFER, or one BLOCK_SECTOR_SIZE-byte element of BUFFERS per
+   sector. */
+struct ide_buffers
+  {
+    uint8_t *buffer;
+    void *const *buffers;
+  };
+
+/* Returns the memory for sector I of the transfer into or out
+   of B. */
+static void *
+ide_buffer (const struct ide_buffers *b, size_t i)
+{
+  return (b->buffers != NULL
+          ? b->buffers[i]
+          : b->buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Fills in C's PRD table to describe the CNT sectors in B.
+   Returns false if B cannot be used for DMA, because a buffer is
+   not in kernel memory or is not word-aligned, or if the table
+   would overflow; the caller must then use PIO. */
+static bool
+build_prdt (struct channel *c, const struct ide_buffers *b, size_t cnt)
+{
+  size_t prd_cnt = 0;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      const void *buffer = ide_buffer (b, i);
+      uint32_t addr, end;
+
+      if (!is_kernel_vaddr (buffer) || (uintptr_t) buffer % 2 != 0)
+        return false;
+
+      /* Kernel virtual memory maps physical memory linearly, so
+         each buffer is physically contiguous. */
+      addr = vtop (buffer);
+      end = addr + BLOCK_SECTOR_SIZE;
+      while (addr < end)
+        {
+          uint32_t limit = ROUND_DOWN (addr, PRD_BOUNDARY) + PRD_BOUNDARY;
+          uint32_t size = (end < limit ? end : limit) - addr;
+          struct prd *last = prd_cnt > 0 ? &c->prdt[prd_cnt - 1] : NULL;
+          uint32_t last_size = (last == NULL ? 0
+                                : last->size != 0 ? last->size
+                                : PRD_BOUNDARY);
+
+          if (last != NULL && last->addr + last_size == addr
+              && last->addr / PRD_BOUNDARY == (addr + size - 1) / PRD_BOUNDARY)
+            last->size = last_size + size;   /* 64 kB wraps to 0. */
+          else if (prd_cnt < PRD_CNT)
+            {
+              struct prd *prd = &c->prdt[prd_cnt++];
+              prd->addr = addr;
+              prd->size = size;
+              prd->flags = 0;
+            }
+          else
+            return false;
+          addr += size;
+        }
+    }
+  c->prdt[prd_cnt - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and the memory described by its channel's PRD table, reading
+   if WRITE is false and writing otherwise.  The calling thread
+   sleeps until the disk interrupts at the end, leaving the CPU
+   to other threads.  The channel's lock must be held. */
+static void
+ide_transfer_dma (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+                  bool write)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BM_READ;
+  uint8_t bm_status;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), inb (reg_bm_status (c)) | BM_ERROR | BM_INTR);
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BM_START);
+  sema_down (&c->completion_wait);
+  outb (reg_bm_command (c), direction);
+
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), bm_status | BM_ERROR | BM_INTR);
+  if ((bm_status & BM_ERROR) != 0 || (inb (reg_status (c)) & STA_ERR) != 0)
+    PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+           d->name, write ? "write" : "read", sec_no);
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and B with a single command, reading if WRITE is false and
+   writing otherwise.  If D supports READ MULTIPLE and WRITE
+   MULTIPLE, the disk interrupts once per D->multiple sectors;
+   otherwise we fall back to READ SECTOR or WRITE SECTOR with a
+   sector count, which interrupts once per sector.
+   Uses DMA instead if D and the memory in B allow it.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct ide_buffers *b, size_t cnt, bool write)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+  uint8_t command;
+  size_t i, j;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (d->dma && build_prdt (c, b, cnt))
+    {
+      ide_transfer_dma (d, sec_no, cnt, write);
+      d->dma_cnt[write] += cnt;
+      lock_release (&c->lock);
+      return;
+    }
+  d->pio_cnt[write] += cnt;
+
+  if (d->multiple > 0)
+    command = write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, command);
+  for (i = 0; i < cnt; i += per_intr)
+    {
+      size_t block_cnt = cnt - i < per_intr ? cnt - i : per_intr;
+
+      /* A read interrupts when each block is ready; a write
+         interrupts after each block has been accepted. */
+      if (!write)
+        sema_down (&c->completion_wait);
+      if (!wait_while_busy (d))
+        PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+               d->name, write ? "write" : "read",
+               sec_no + (block_sector_t) i);
+      for (j = 0; j < block_cnt; j++)
+        if (write)
+          output_sector (c, ide_buffer (b, i + j));
+        else
+          input_sector (c, ide_buffer (b, i + j));
+      if (write)
+        sema_down (&c->completion_wait);
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d, block_sector_t sec_no, void *buffer)
+{
+  struct ide_buffers b = {buffer, NULL};
+  ide_transfer (d, sec_no, &b, 1, false);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+ide_write (void *d, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  struct ide_buffers b = {(uint8_t *) buffer, NULL};
+  ide_transfer (d, sec_no, &b, 1, true);
+}
+
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFERS, as a single command. */
+static void
+ide_readv (void *d, block_sector_t sec_no, void *const buffers[], size_t cnt)
+{
+  struct ide_buffers b = {NULL, buffers};
+  ide_transfer (d, sec_no, &b, cnt, false);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFERS, as a single command. */
+static void
+ide_writev (void *d, block_sector_t sec_no,
+            const void *const buffers[], size_t cnt)
+{
+  /* ide_transfer() only reads from BUFFERS when writing. */
+  struct ide_buffers b = {NULL, (void *const *) buffers};
+  ide_transfer (d, sec_no, &b, cnt, true);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_readv,
+    ide_writev,
+    NULL,
+    NULL
   };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and CNT, which must be between 1 and 256, to
+   the disk's sector selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= 256);
 
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);      /* 256 is written as 0. */
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -460,25 +837,42 @@ static bool
 wait_while_busy (const struct ata_disk *d)
 {
   struct channel *c = d->channel;
+  int64_t waited = 0;
+  bool warned = false;
   int i;
 
-  for (i = 0; i < 3000; i++)
+  for (i = 0; waited < 30 * 1000 * 1000; i++)
     {
-      if (i == 700)
-        printf ("%s: busy, waiting...", d->name);
+      if (!warned && waited >= 7 * 1000 * 1000)
+        {
+          printf ("%s: busy, waiting...", d->name);
+          warned = true;
+        }
       if (!(inb (reg_alt_status (c)) & STA_BSY))
         {
-          if (i >= 700)
+          if (warned)
             printf ("ok\n");
           return (inb (reg_alt_status (c)) & STA_DRQ) != 0;
         }
-      timer_msleep (10);
+      waited += poll_backoff (i);
     }
 
   printf ("failed\n");
   return false;
 }
 
+/* Sleeps before the next poll of a busy device, I being the
+   number of polls so far, and returns the microseconds slept.
+   Polls start 10 us apart and back off to 10 ms, so that a
+   device that becomes ready quickly is noticed quickly. */
+static int
+poll_backoff (int i)
+{
+  int us = i < 10 ? 10 << i : 10 * 1000;
+  timer_usleep (us);
+  return us;
+}
+
 /* Program D's channel so that D is now the selected disk. */
 static void
 select_device (const struct ata_disk *d)
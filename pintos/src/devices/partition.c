@@ -23,6 +23,12 @@ static void found_partition (struct block *, uint8_t type,
                              int part_nr);
 static const char *partition_type_name (uint8_t);
 
+/* Devices whose partition tables have yet to be read, in the
+   order that partition_defer() saw them. */
+#define DEFERRED_MAX 16
+static struct block *deferred[DEFERRED_MAX];
+static size_t deferred_cnt;
+
 /* Scans BLOCK for partitions of interest to Pintos. */
 void
 partition_scan (struct block *block)
@@ -33,6 +39,41 @@ partition_scan (struct block *block)
     printf ("%s: Device contains no partitions\n", block_name (block));
 }
 
+/* Arranges for BLOCK to be scanned for partitions when it is
+   first looked up, through partition_scan_if_deferred(), rather
+   than now.  Drivers use this to keep partition table reads out
+   of device probing, and a disk that nothing looks for is never
+   scanned.
+
+   If too many devices are pending, scans the oldest first. */
+void
+partition_defer (struct block *block)
+{
+  if (deferred_cnt >= DEFERRED_MAX)
+    partition_scan_if_deferred (deferred[0]);
+  deferred[deferred_cnt++] = block;
+}
+
+/* If BLOCK was passed to partition_defer() and has not been
+   scanned yet, scans it now. */
+void
+partition_scan_if_deferred (struct block *block)
+{
+  size_t i;
+
+  for (i = 0; i < deferred_cnt; i++)
+    if (deferred[i] == block)
+      {
+        /* Take BLOCK off the list first, so that it is scanned
+           only once. */
+        memmove (&deferred[i], &deferred[i + 1],
+                 (deferred_cnt - i - 1) * sizeof *deferred);
+        deferred_cnt--;
+        partition_scan (block);
+        return;
+      }
+}
+
 /* Reads the partition table in the given SECTOR of BLOCK and
    scans it for partitions of interest to Pintos.
 
@@ -298,27 +339,24 @@ partition_type_name (uint8_t type)
   return type_names[type] != NULL ? type_names[type] : "Unknown";
 }
 
-/* Reads sector SECTOR from partition P into BUFFER, which must
-   have room for BLOCK_SECTOR_SIZE bytes. */
-static void
-partition_read (void *p_, block_sector_t sector, void *buffer)
-{
-  struct partition *p = p_;
-  block_read (p->block, p->start + sector, buffer);
-}
-
-/* Write sector SECTOR to partition P from BUFFER, which must
-   contain BLOCK_SECTOR_SIZE bytes.  Returns after the block has
-   acknowledged receiving the data. */
-static void
-partition_write (void *p_, block_sector_t sector, const void *buffer)
+/* Returns the device that partition P is on and converts
+   *SECTOR from a sector within P into a sector on that device.
+   Requests for P thereby join the device's own queue, where they
+   can be scheduled and merged along with everything else. */
+static struct block *
+partition_map (void *p_, block_sector_t *sector)
 {
   struct partition *p = p_;
-  block_write (p->block, p->start + sector, buffer);
+  *sector += p->start;
+  return p->block;
 }
 
 static struct block_operations partition_operations =
   {
-    partition_read,
-    partition_write
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    partition_map,
+    NULL
   };
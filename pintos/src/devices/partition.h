@@ -4,5 +4,7 @@
 struct block;
 
 void partition_scan (struct block *);
+void partition_defer (struct block *);
+void partition_scan_if_deferred (struct block *);
 
 #endif /* devices/partition.h */
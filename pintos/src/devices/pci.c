@@ -0,0 +1,160 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* Interface to PCI configuration space, through configuration
+   mechanism #1, which every PCI chipset since the original
+   PIIX, and every emulator Pintos runs on, provides. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8        /* Selects a register. */
+#define PCI_CONFIG_DATA 0xcfc           /* Reads or writes it. */
+
+/* Bus, device, and function counts that we scan. */
+#define PCI_BUS_CNT 256
+#define PCI_DEV_CNT 32
+#define PCI_FUNC_CNT 8
+
+/* Selects 32-bit configuration register REG of function FUNC of
+   device DEV on BUS for access through PCI_CONFIG_DATA. */
+static void
+select_config (int bus, int dev, int func, int reg)
+{
+  ASSERT (reg % 4 == 0 && reg < 256);
+  outl (PCI_CONFIG_ADDRESS,
+        0x80000000 | (bus << 16) | (dev << 11) | (func << 8) | reg);
+}
+
+/* Reads 32-bit configuration register REG of function FUNC of
+   device DEV on BUS. */
+static uint32_t
+read_config (int bus, int dev, int func, int reg)
+{
+  select_config (bus, dev, func, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Reads 32-bit configuration register REG of device D. */
+uint32_t
+pci_read_config (const struct pci_device *d, int reg)
+{
+  return read_config (d->bus, d->dev, d->func, reg);
+}
+
+/* Writes VALUE to 32-bit configuration register REG of device
+   D. */
+void
+pci_write_config (const struct pci_device *d, int reg, uint32_t value)
+{
+  select_config (d->bus, d->dev, d->func, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Scans the PCI buses, describing each function found in *D
+   and passing it to MATCH along with AUX, until MATCH has
+   returned true for the IDX'th time, counting from 0.  Returns
+   true if so, with *D describing that function, or false if the
+   functions ran out first. */
+static bool
+scan (bool (*match) (const struct pci_device *, const void *aux),
+      const void *aux, int idx, struct pci_device *d)
+{
+  int bus, dev, func;
+
+  for (bus = 0; bus < PCI_BUS_CNT; bus++)
+    for (dev = 0; dev < PCI_DEV_CNT; dev++)
+      for (func = 0; func < PCI_FUNC_CNT; func++)
+        {
+          uint32_t id = read_config (bus, dev, func, PCI_REG_ID);
+          uint32_t class_reg;
+
+          if ((id & 0xffff) == 0xffff)
+            {
+              /* No such function.  If function 0 is missing, so
+                 is the whole device. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          class_reg = read_config (bus, dev, func, PCI_REG_CLASS);
+          d->bus = bus;
+          d->dev = dev;
+          d->func = func;
+          d->vendor_id = id & 0xffff;
+          d->device_id = id >> 16;
+          d->class = class_reg >> 24;
+          d->subclass = (class_reg >> 16) & 0xff;
+          d->prog_if = (class_reg >> 8) & 0xff;
+          if (match (d, aux) && idx-- == 0)
+            return true;
+
+          /* Only multi-function devices have functions 1...7. */
+          if (func == 0
+              && !(read_config (bus, dev, 0, PCI_REG_HEADER) & 0x800000))
+            break;
+        }
+  return false;
+}
+
+/* scan() match function for pci_find_class().  AUX_ points to
+   the wanted class and subclass codes. */
+static bool
+match_class (const struct pci_device *d, const void *aux_)
+{
+  const uint8_t *aux = aux_;
+  return d->class == aux[0] && d->subclass == aux[1];
+}
+
+/* Scans the PCI buses for the first function with the given
+   CLASS and SUBCLASS codes.  If one is found, describes it in
+   *D and returns true; otherwise returns false. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, struct pci_device *d)
+{
+  uint8_t aux[2] = {class, subclass};
+  return scan (match_class, aux, 0, d);
+}
+
+/* scan() match function for pci_find_device().  AUX_ points to
+   the wanted vendor and device IDs. */
+static bool
+match_device (const struct pci_device *d, const void *aux_)
+{
+  const uint16_t *aux = aux_;
+  return d->vendor_id == aux[0] && d->device_id == aux[1];
+}
+
+/* Scans the PCI buses for the IDX'th function, counting from 0,
+   with the given VENDOR_ID and DEVICE_ID.  If there is one,
+   describes it in *D and returns true; otherwise returns
+   false. */
+bool
+pci_find_device (uint16_t vendor_id, uint16_t device_id, int idx,
+                 struct pci_device *d)
+{
+  uint16_t aux[2] = {vendor_id, device_id};
+  return scan (match_device, aux, idx, d);
+}
+
+/* Returns the I/O port base address in base address register
+   BAR of device D, or 0 if BAR is unset or maps memory. */
+uint16_t
+pci_io_bar (const struct pci_device *d, int bar)
+{
+  uint32_t value;
+
+  ASSERT (bar >= 0 && bar < 6);
+  value = pci_read_config (d, PCI_REG_BAR0 + bar * 4);
+  return (value & 1) != 0 ? value & 0xfffc : 0;
+}
+
+/* Sets the PCI_CMD_* bits in COMMAND in device D's command
+   register.  The status register shares the same 32 bits, and
+   writing 1 to a status bit clears it, so we write zeros there. */
+void
+pci_enable (const struct pci_device *d, uint16_t command)
+{
+  uint32_t value = pci_read_config (d, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (d, PCI_REG_COMMAND, value | command);
+}
@@ -0,0 +1,46 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A PCI function, as found by pci_find_class() or
+   pci_find_device(). */
+struct pci_device
+  {
+    uint8_t bus;                /* Bus number. */
+    uint8_t dev;                /* Device number on the bus. */
+    uint8_t func;               /* Function number within the device. */
+    uint16_t vendor_id;         /* Vendor ID. */
+    uint16_t device_id;         /* Device ID. */
+    uint8_t class;              /* Base class code. */
+    uint8_t subclass;           /* Subclass code. */
+    uint8_t prog_if;            /* Programming interface. */
+  };
+
+/* Class codes. */
+#define PCI_CLASS_STORAGE 0x01          /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /* ...IDE controller. */
+
+/* Configuration space registers. */
+#define PCI_REG_ID 0x00                 /* Vendor ID, device ID. */
+#define PCI_REG_COMMAND 0x04            /* Command (16 bits). */
+#define PCI_REG_CLASS 0x08              /* Revision, class codes. */
+#define PCI_REG_HEADER 0x0c             /* Header type in bits 23:16. */
+#define PCI_REG_BAR0 0x10               /* Base address registers. */
+#define PCI_REG_INTERRUPT 0x3c          /* Interrupt line in bits 7:0. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001               /* Respond to I/O space. */
+#define PCI_CMD_MEMORY 0x0002           /* Respond to memory space. */
+#define PCI_CMD_BUS_MASTER 0x0004       /* Allow bus mastering. */
+
+uint32_t pci_read_config (const struct pci_device *, int reg);
+void pci_write_config (const struct pci_device *, int reg, uint32_t);
+bool pci_find_class (uint8_t class, uint8_t subclass, struct pci_device *);
+bool pci_find_device (uint16_t vendor_id, uint16_t device_id, int idx,
+                      struct pci_device *);
+uint16_t pci_io_bar (const struct pci_device *, int bar);
+void pci_enable (const struct pci_device *, uint16_t command);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,270 @@
+#include "devices/raid.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+
+/* Software RAID.
+
+   Combines block devices, ideally on different IDE channels so
+   that their requests really overlap, into a single device named
+   "md0" that the file system can use like any other.  RAID-0
+   stripes the array's sectors across the members in chunks of
+   RAID_CHUNK sectors.  RAID-1 stores a full copy on each member,
+   writes to all of them, and spreads reads among them a chunk at
+   a time.
+
+   Requests to the array are split into at most one request per
+   member and submitted to the members' own queues at once, so
+   the members seek and transfer in parallel.  The parts point
+   into the array request's own buffers, which the members' I/O
+   threads fill or drain, so like those of any request they must
+   be in kernel memory.  The array is described only by the
+   kernel command line; nothing is stored on the members, so they
+   must be given in the same order at every boot. */
+
+/* Most members in an array. */
+#define RAID_MAX_MEMBERS 4
+
+/* Sectors in a stripe chunk. */
+#define RAID_CHUNK 8
+
+/* A RAID array. */
+struct raid
+  {
+    int level;                          /* 0 or 1. */
+    int member_cnt;                     /* Number of members. */
+    struct block *members[RAID_MAX_MEMBERS];
+  };
+
+/* A request to an array in progress. */
+struct raid_io
+  {
+    struct block_request *request;      /* Request to the array. */
+    int pending;                        /* Parts not yet complete. */
+    struct block_request parts[RAID_MAX_MEMBERS];
+
+    /* For RAID-0, room for the request's buffers for each
+       member, in runs of the request's length. */
+    void *buffers[];
+  };
+
+static struct block_operations raid_operations;
+
+/* Creates RAID array md0 with the given LEVEL, 0 or 1, from the
+   comma-separated block device names in MEMBERS, which this
+   function modifies.  Panics if the array cannot be created. */
+void
+raid_create (int level, char *members)
+{
+  struct raid *raid;
+  block_sector_t size;
+  char *name, *save_ptr;
+  char extra_info[64];
+  int i;
+
+  if (level != 0 && level != 1)
+    PANIC ("RAID level %d not supported", level);
+
+  raid = malloc (sizeof *raid);
+  if (raid == NULL)
+    PANIC ("Failed to allocate memory for RAID array");
+  raid->level = level;
+  raid->member_cnt = 0;
+  for (name = strtok_r (members, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("RAID member \"%s\" does not exist", name);
+      if (raid->member_cnt >= RAID_MAX_MEMBERS)
+        PANIC ("RAID arrays have at most %d members", RAID_MAX_MEMBERS);
+      raid->members[raid->member_cnt++] = block;
+    }
+  if (raid->member_cnt < 2)
+    PANIC ("RAID array needs at least two members");
+
+  /* Every member contributes as much as the smallest. */
+  size = block_size (raid->members[0]);
+  for (i = 1; i < raid->member_cnt; i++)
+    if (block_size (raid->members[i]) < size)
+      size = block_size (raid->members[i]);
+  if (level == 0)
+    size = size / RAID_CHUNK * RAID_CHUNK * raid->member_cnt;
+
+  snprintf (extra_info, sizeof extra_info, "RAID-%d over", level);
+  for (i = 0; i < raid->member_cnt; i++)
+    {
+      strlcat (extra_info, i > 0 ? ", " : " ", sizeof extra_info);
+      strlcat (extra_info, block_name (raid->members[i]), sizeof extra_info);
+    }
+  block_register ("md0", BLOCK_RAW, extra_info, size, &raid_operations, raid);
+}
+
+/* Returns the member of RAID-0 array RAID that holds SECTOR and
+   sets *MEMBER_SECTOR to its sector number there. */
+static int
+raid0_map (const struct raid *raid, block_sector_t sector,
+           block_sector_t *member_sector)
+{
+  block_sector_t chunk = sector / RAID_CHUNK;
+
+  *member_sector = (chunk / raid->member_cnt * RAID_CHUNK
+                    + sector % RAID_CHUNK);
+  return chunk % raid->member_cnt;
+}
+
+/* Returns the address of the Ith sector's buffer in R. */
+static void *
+request_buffer (const struct block_request *r, size_t i)
+{
+  return (r->buffers != NULL
+          ? r->buffers[i]
+          : (uint8_t *) r->buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Completion function for the part of a request to an array
+   that went to one member.  Completes the request to the array
+   when the last part finishes. */
+static void
+raid_part_complete (struct block_request *part)
+{
+  struct raid_io *io = part->aux;
+  enum intr_level old_level;
+  bool last;
+
+  /* Members' I/O threads may finish parts at the same time. */
+  old_level = intr_disable ();
+  last = --io->pending == 0;
+  intr_set_level (old_level);
+
+  if (last)
+    {
+      block_complete (io->request);
+      free (io);
+    }
+}
+
+/* Handles request R without allocating memory, by doing each
+   sector in turn and waiting for it. */
+static void
+raid_submit_slow (struct raid *raid, struct block_request *r)
+{
+  size_t i;
+
+  for (i = 0; i < r->cnt; i++)
+    {
+      block_sector_t sector = r->sector + i;
+      int m;
+
+      if (raid->level == 0)
+        {
+          m = raid0_map (raid, sector, &sector);
+          if (r->write)
+            block_write (raid->members[m], sector, request_buffer (r, i));
+          else
+            block_read (raid->members[m], sector, request_buffer (r, i));
+        }
+      else if (r->write)
+        for (m = 0; m < raid->member_cnt; m++)
+          block_write (raid->members[m], sector, request_buffer (r, i));
+      else
+        block_read (raid->members[0], sector, request_buffer (r, i));
+    }
+  block_complete (r);
+}
+
+/* Splits request R to array RAID_ into one request per member
+   involved and submits them all. */
+static void
+raid_submit (void *raid_, struct block_request *r)
+{
+  struct raid *raid = raid_;
+  struct raid_io *io;
+  struct block *targets[RAID_MAX_MEMBERS];
+  int part_cnt;
+  int i;
+
+  io = malloc (sizeof *io
+               + (raid->level == 0
+                  ? raid->member_cnt * r->cnt * sizeof *io->buffers : 0));
+  if (io == NULL)
+    {
+      raid_submit_slow (raid, r);
+      return;
+    }
+  io->request = r;
+
+  if (raid->level == 0)
+    {
+      /* Consecutive chunks on one member are consecutive there,
+         so each member gets one run of sectors. */
+      int index[RAID_MAX_MEMBERS];
+      size_t j;
+
+      part_cnt = 0;
+      for (i = 0; i < raid->member_cnt; i++)
+        index[i] = -1;
+      for (j = 0; j < r->cnt; j++)
+        {
+          block_sector_t sector;
+          int m = raid0_map (raid, r->sector + j, &sector);
+          struct block_request *part;
+
+          if (index[m] < 0)
+            {
+              index[m] = part_cnt++;
+              part = &io->parts[index[m]];
+              part->sector = sector;
+              part->cnt = 0;
+              part->buffer = NULL;
+              part->buffers = io->buffers + index[m] * r->cnt;
+              targets[index[m]] = raid->members[m];
+            }
+          part = &io->parts[index[m]];
+          io->buffers[index[m] * r->cnt + part->cnt]
+            = request_buffer (r, j);
+          part->cnt++;
+        }
+    }
+  else
+    {
+      /* Writes go to every member, reads to one. */
+      part_cnt = r->write ? raid->member_cnt : 1;
+      for (i = 0; i < part_cnt; i++)
+        {
+          struct block_request *part = &io->parts[i];
+          part->sector = r->sector;
+          part->cnt = r->cnt;
+          part->buffer = r->buffer;
+          part->buffers = r->buffers;
+          targets[i] = (r->write
+                        ? raid->members[i]
+                        : raid->members[r->sector / RAID_CHUNK
+                                        % raid->member_cnt]);
+        }
+    }
+
+  /* Every part must be counted before the first one can
+     complete. */
+  io->pending = part_cnt;
+  for (i = 0; i < part_cnt; i++)
+    {
+      io->parts[i].write = r->write;
+      io->parts[i].complete = raid_part_complete;
+      io->parts[i].aux = io;
+      block_submit (targets[i], &io->parts[i]);
+    }
+}
+
+static struct block_operations raid_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    raid_submit
+  };
@@ -0,0 +1,6 @@
+#ifndef DEVICES_RAID_H
+#define DEVICES_RAID_H
+
+void raid_create (int level, char *members);
+
+#endif /* devices/raid.h */
@@ -0,0 +1,9 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include "devices/block.h"
+
+void ramdisk_create (block_sector_t size);
+void ramdisk_preload (struct block *src);
+
+#endif /* devices/ramdisk.h */
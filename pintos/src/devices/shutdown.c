@@ -11,7 +11,9 @@
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
+#include "devices/ide.h"
 #include "filesys/filesys.h"
+#include "filesys/fsutil.h"
 #endif
 
 /* Keyboard control register port. */
@@ -92,6 +94,7 @@ shutdown_power_off (void)
 
 #ifdef FILESYS
   filesys_done ();
+  fsutil_append_trace ();
 #endif
 
   print_stats ();
@@ -132,6 +135,7 @@ print_stats (void)
   thread_print_stats ();
 #ifdef FILESYS
   block_print_stats ();
+  ide_print_stats ();
 #endif
   console_print_stats ();
   kbd_print_stats ();
@@ -0,0 +1,461 @@
+#include "devices/virtio.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices through the
+   legacy ("virtio 0.9.5") PCI interface, which QEMU provides for
+   disks attached with "-drive if=virtio".  Each disk has a
+   single virtqueue: a ring of descriptors that point to request
+   headers, data buffers, and status bytes, plus an "available"
+   ring through which we hand requests to the device and a
+   "used" ring through which it hands them back.
+
+   Unlike the IDE driver, which does one command at a time, we
+   put requests on the ring as soon as they are submitted, so
+   that many can be in flight at once.  The device interrupts
+   when it finishes some; a kernel thread per disk then retires
+   them and completes the block requests. */
+
+/* PCI IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR_ID 0x1af4
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+
+/* Legacy virtio I/O port addresses. */
+#define reg_features(D) ((D)->io_base + 0x00)        /* Device features. */
+#define reg_guest_features(D) ((D)->io_base + 0x04)  /* Driver features. */
+#define reg_queue_pfn(D) ((D)->io_base + 0x08)       /* Ring page number. */
+#define reg_queue_size(D) ((D)->io_base + 0x0c)      /* Ring size (r/o). */
+#define reg_queue_select(D) ((D)->io_base + 0x0e)    /* Ring selection. */
+#define reg_queue_notify(D) ((D)->io_base + 0x10)    /* Kick a ring. */
+#define reg_status(D) ((D)->io_base + 0x12)          /* Device status. */
+#define reg_isr(D) ((D)->io_base + 0x13)             /* ISR (read clears). */
+#define reg_capacity(D) ((D)->io_base + 0x14)        /* Sectors, 64 bits. */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* We found the device. */
+#define STATUS_DRIVER 0x02      /* We know how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* We are ready. */
+#define STATUS_FAILED 0x80      /* We gave up. */
+
+/* ISR bits. */
+#define ISR_QUEUE 0x01          /* The used ring has new entries. */
+
+/* A virtqueue descriptor, one piece of memory for the device to
+   read or write. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* bits. */
+    uint16_t next;              /* Next descriptor, with F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* NEXT is valid. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads. */
+
+/* Ring of requests handed to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where we put the next entry. */
+    uint16_t ring[];            /* First descriptor of each request. */
+  };
+
+/* Ring of requests handed back by the device. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* First descriptor of the request. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* The legacy interface puts the used ring on the page after the
+   descriptors and available ring. */
+#define VRING_ALIGN PGSIZE
+
+/* Block request header. */
+struct virtio_blk_header
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* In 512-byte units. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Status byte on success. */
+
+/* A request on the ring. */
+struct virtio_slot
+  {
+    struct virtio_blk_header header;    /* Read by the device. */
+    uint8_t status;                     /* Written by the device. */
+    struct block_request *request;      /* What we are doing. */
+  };
+
+/* A virtio block device. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+    bool ready;                 /* Set up and able to interrupt? */
+
+    struct lock lock;           /* Protects the members below. */
+    struct condition desc_free; /* Signaled when descriptors are freed. */
+    struct semaphore used_wait; /* Up'd by interrupt handler. */
+
+    uint16_t size;              /* Number of descriptors. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    struct vring_used *used;    /* Used ring. */
+    uint16_t free_head;         /* First free descriptor. */
+    uint16_t free_cnt;          /* Number of free descriptors. */
+    uint16_t last_used;         /* Used ring entries retired. */
+
+    /* Requests, indexed by first descriptor. */
+    struct virtio_slot *slots;
+  };
+
+/* Disks found by virtio_blk_init(). */
+#define DISK_MAX 4
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+/* Vectors whose handler we have registered. */
+static bool irq_registered[16];
+
+static struct block_operations virtio_operations;
+
+static bool init_disk (struct virtio_disk *, const struct pci_device *);
+static thread_func completion_thread NO_RETURN;
+static intr_handler_func interrupt_handler;
+
+/* Finds and initializes the virtio block devices, and registers
+   them and their partitions. */
+void
+virtio_blk_init (void)
+{
+  struct pci_device pci;
+  int idx;
+
+  for (idx = 0; disk_cnt < DISK_MAX
+         && pci_find_device (VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID,
+                             idx, &pci);
+       idx++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (init_disk (d, &pci))
+        disk_cnt++;
+    }
+}
+
+/* Sets up virtio block device D, found at PCI, and registers it.
+   Returns true if successful, false if the device is unusable. */
+static bool
+init_disk (struct virtio_disk *d, const struct pci_device *pci)
+{
+  size_t desc_bytes, avail_bytes, used_bytes;
+  uint8_t *ring;
+  uint8_t irq;
+  uint32_t capacity_lo, capacity_hi;
+  block_sector_t capacity;
+  struct block *block;
+  char extra_info[64];
+  char name[16];
+  size_t i;
+
+  d->io_base = pci_io_bar (pci, 0);
+  irq = pci_read_config (pci, PCI_REG_INTERRUPT) & 0xff;
+  if (d->io_base == 0 || irq == 0 || irq >= 16)
+    {
+      printf ("%s: unusable PCI configuration\n", d->name);
+      return false;
+    }
+  d->irq = irq + 0x20;
+  pci_enable (pci, PCI_CMD_IO | PCI_CMD_BUS_MASTER);
+
+  /* Reset the device and tell it we are here.  We use none of
+     the optional features it offers. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  inl (reg_features (d));
+  outl (reg_guest_features (d), 0);
+
+  /* Set up the ring, whose size the device dictates. */
+  outw (reg_queue_select (d), 0);
+  d->size = inw (reg_queue_size (d));
+  if (d->size < 3)
+    {
+      printf ("%s: virtqueue too small\n", d->name);
+      outb (reg_status (d), STATUS_FAILED);
+      return false;
+    }
+  desc_bytes = d->size * sizeof *d->desc;
+  avail_bytes = sizeof *d->avail + (d->size + 1) * sizeof *d->avail->ring;
+  used_bytes = sizeof *d->used + d->size * sizeof *d->used->ring;
+  ring = palloc_get_multiple (PAL_ZERO,
+                              (ROUND_UP (desc_bytes + avail_bytes,
+                                         VRING_ALIGN)
+                               + ROUND_UP (used_bytes, VRING_ALIGN)) / PGSIZE);
+  d->slots = malloc (d->size * sizeof *d->slots);
+  if (ring == NULL || d->slots == NULL)
+    PANIC ("%s: cannot allocate virtqueue", d->name);
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + desc_bytes);
+  d->used = (struct vring_used *) (ring + ROUND_UP (desc_bytes + avail_bytes,
+                                                    VRING_ALIGN));
+  for (i = 0; i < d->size; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = d->size;
+  d->last_used = 0;
+  outl (reg_queue_pfn (d), vtop (ring) >> PGBITS);
+
+  lock_init (&d->lock);
+  cond_init (&d->desc_free);
+  sema_init (&d->used_wait, 0);
+  snprintf (name, sizeof name, "%.10s-done", d->name);
+  thread_create (name, PRI_DEFAULT, completion_thread, d);
+  if (!irq_registered[irq])
+    {
+      intr_register_ext (d->irq, interrupt_handler, "virtio");
+      irq_registered[irq] = true;
+    }
+  d->ready = true;
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register. */
+  capacity_lo = inl (reg_capacity (d));
+  capacity_hi = inl (reg_capacity (d) + 4);
+  capacity = capacity_hi != 0 ? UINT32_MAX : capacity_lo;
+  snprintf (extra_info, sizeof extra_info, "virtio, %"PRIu16"-entry ring",
+            d->size);
+  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+                          &virtio_operations, d);
+  partition_defer (block);
+  return true;
+}
+
+/* Takes a free descriptor from disk D and returns its index.
+   D's lock must be held and a descriptor must be free. */
+static uint16_t
+alloc_desc (struct virtio_disk *d)
+{
+  uint16_t idx = d->free_head;
+
+  ASSERT (d->free_cnt > 0);
+  d->free_head = d->desc[idx].next;
+  d->free_cnt--;
+  return idx;
+}
+
+/* Links descriptor NEXT after descriptor PREV on disk D. */
+static void
+chain_desc (struct virtio_disk *d, uint16_t prev, uint16_t next)
+{
+  d->desc[prev].flags |= VRING_DESC_F_NEXT;
+  d->desc[prev].next = next;
+}
+
+/* Returns the address of the Ith sector's buffer in R. */
+static void *
+request_buffer (const struct block_request *r, size_t i)
+{
+  return (r->buffers != NULL
+          ? r->buffers[i]
+          : (uint8_t *) r->buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Puts request R on disk D_'s ring and returns without waiting
+   for it, unless the ring is full.  R's buffers must be in
+   kernel memory, which is physically contiguous, so runs of
+   adjacent buffers take just one descriptor. */
+static void
+virtio_submit (void *d_, struct block_request *r)
+{
+  struct virtio_disk *d = d_;
+  struct virtio_slot *slot;
+  uint16_t head, prev, idx;
+  size_t i;
+
+  if (r->cnt > (size_t) d->size - 2)
+    {
+      /* The request might not fit on the ring at all, so do it
+         in pieces that will, one at a time. */
+      size_t piece_max = d->size - 2;
+
+      for (i = 0; i < r->cnt; i += piece_max)
+        {
+          struct block_request piece;
+
+          piece.write = r->write;
+          piece.sector = r->sector + i;
+          piece.cnt = r->cnt - i < piece_max ? r->cnt - i : piece_max;
+          piece.buffer = (r->buffer != NULL
+                          ? (uint8_t *) r->buffer + i * BLOCK_SECTOR_SIZE
+                          : NULL);
+          piece.buffers = r->buffers != NULL ? r->buffers + i : NULL;
+          piece.complete = NULL;
+          piece.block = NULL;
+          sema_init (&piece.done, 0);
+          virtio_submit (d, &piece);
+          block_wait (&piece);
+        }
+      block_complete (r);
+      return;
+    }
+
+  lock_acquire (&d->lock);
+  while (d->free_cnt < r->cnt + 2)
+    cond_wait (&d->desc_free, &d->lock);
+
+  /* Header. */
+  head = alloc_desc (d);
+  slot = &d->slots[head];
+  slot->header.type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  slot->header.reserved = 0;
+  slot->header.sector = r->sector;
+  slot->status = 0xff;
+  slot->request = r;
+  d->desc[head].addr = vtop (&slot->header);
+  d->desc[head].len = sizeof slot->header;
+  d->desc[head].flags = 0;
+
+  /* Data. */
+  prev = head;
+  for (i = 0; i < r->cnt; i++)
+    {
+      void *buffer = request_buffer (r, i);
+      uintptr_t paddr;
+
+      paddr = vtop (buffer);
+      if (prev != head && d->desc[prev].addr + d->desc[prev].len == paddr)
+        {
+          d->desc[prev].len += BLOCK_SECTOR_SIZE;
+          continue;
+        }
+      idx = alloc_desc (d);
+      d->desc[idx].addr = paddr;
+      d->desc[idx].len = BLOCK_SECTOR_SIZE;
+      d->desc[idx].flags = r->write ? 0 : VRING_DESC_F_WRITE;
+      chain_desc (d, prev, idx);
+      prev = idx;
+    }
+
+  /* Status. */
+  idx = alloc_desc (d);
+  d->desc[idx].addr = vtop (&slot->status);
+  d->desc[idx].len = sizeof slot->status;
+  d->desc[idx].flags = VRING_DESC_F_WRITE;
+  chain_desc (d, prev, idx);
+
+  /* Hand it to the device.  The device must see the ring entry
+     before the new index, and both before the notification. */
+  d->avail->ring[d->avail->idx % d->size] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (reg_queue_notify (d), 0);
+  lock_release (&d->lock);
+}
+
+/* Thread function that retires the requests that disk D_ hands
+   back, and completes them. */
+static void
+completion_thread (void *d_)
+{
+  struct virtio_disk *d = d_;
+
+  for (;;)
+    {
+      sema_down (&d->used_wait);
+      lock_acquire (&d->lock);
+      while (d->last_used != *(volatile uint16_t *) &d->used->idx)
+        {
+          struct vring_used_elem *e;
+          struct virtio_slot *slot;
+          struct block_request *r;
+          uint16_t idx;
+
+          /* Read the entry only after seeing the index. */
+          barrier ();
+          e = &d->used->ring[d->last_used % d->size];
+          idx = e->id;
+          slot = &d->slots[idx];
+          r = slot->request;
+
+          if (slot->status != VIRTIO_BLK_S_OK)
+            PANIC ("%s: %s error at sector %"PRDSNu" (status %d)",
+                   d->name, r->write ? "write" : "read", r->sector,
+                   slot->status);
+
+          /* Free the request's descriptors. */
+          for (;;)
+            {
+              uint16_t flags = d->desc[idx].flags;
+              uint16_t next = d->desc[idx].next;
+
+              d->desc[idx].next = d->free_head;
+              d->free_head = idx;
+              d->free_cnt++;
+              if (!(flags & VRING_DESC_F_NEXT))
+                break;
+              idx = next;
+            }
+          d->last_used++;
+
+          lock_release (&d->lock);
+          block_complete (r);
+          lock_acquire (&d->lock);
+        }
+      cond_broadcast (&d->desc_free, &d->lock);
+      lock_release (&d->lock);
+    }
+}
+
+/* Virtio interrupt handler.  Disks may share a vector, and
+   reading a disk's ISR acknowledges its interrupt, so we read
+   the ISR of every disk on this vector. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < DISK_MAX; i++)
+    {
+      struct virtio_disk *d = &disks[i];
+      if (d->ready && d->irq == f->vec_no
+          && (inb (reg_isr (d)) & ISR_QUEUE))
+        sema_up (&d->used_wait);
+    }
+}
+
+static struct block_operations virtio_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    virtio_submit
+  };
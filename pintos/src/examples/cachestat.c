@@ -0,0 +1,114 @@
+/* cachestat.c
+
+   Runs a command and reports buffer cache statistics while it
+   runs, like a tiny vmstat for the buffer cache.
+
+   Usage: cachestat SAMPLES COMMAND [ARG...]
+
+   Starts COMMAND, then prints SAMPLES lines of statistics, each
+   showing the activity since the previous line, with a busy
+   wait in between (Pintos has no sleep system call).  Finally
+   waits for COMMAND to exit and prints a line for the rest of
+   its run and a line of totals. */
+
+#include <cache-stats.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Iterations of the busy wait between samples. */
+#define DELAY_LOOPS 2000000
+
+static void
+print_header (void)
+{
+  printf ("%10s %8s %8s %4s %8s %8s %8s %8s %8s %8s\n",
+          "", "hits", "misses", "hit%", "evicts", "dirty", "wbacks",
+          "rmw", "reads", "writes");
+}
+
+/* Prints the difference between NEW and OLD, labeled LABEL. */
+static void
+print_delta (const char *label,
+             const struct cache_stats *new, const struct cache_stats *old)
+{
+  uint64_t hits = new->hits - old->hits;
+  uint64_t misses = new->misses - old->misses;
+  uint64_t lookups = hits + misses;
+
+  printf ("%10s %8llu %8llu %4llu %8llu %8llu %8llu %8llu %8llu %8llu\n",
+          label, hits, misses, lookups > 0 ? hits * 100 / lookups : 0,
+          new->evictions - old->evictions,
+          new->dirty_evictions - old->dirty_evictions,
+          new->write_backs - old->write_backs,
+          new->read_modify_writes - old->read_modify_writes,
+          new->device_reads - old->device_reads,
+          new->device_writes - old->device_writes);
+}
+
+/* Obtains the current statistics into STATS, exiting on
+   failure. */
+static void
+sample (struct cache_stats *stats)
+{
+  if (!cache_stats (stats))
+    {
+      printf ("cachestat: cache_stats failed\n");
+      exit (EXIT_FAILURE);
+    }
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct cache_stats start, prev, cur;
+  char cmd_line[128];
+  pid_t pid;
+  int samples;
+  int i;
+
+  if (argc < 3)
+    {
+      printf ("usage: cachestat SAMPLES COMMAND [ARG...]\n");
+      return EXIT_FAILURE;
+    }
+  samples = atoi (argv[1]);
+
+  cmd_line[0] = '\0';
+  for (i = 2; i < argc; i++)
+    {
+      if (i > 2)
+        strlcat (cmd_line, " ", sizeof cmd_line);
+      strlcat (cmd_line, argv[i], sizeof cmd_line);
+    }
+
+  sample (&start);
+  prev = start;
+  pid = exec (cmd_line);
+  if (pid == PID_ERROR)
+    {
+      printf ("cachestat: exec \"%s\" failed\n", cmd_line);
+      return EXIT_FAILURE;
+    }
+
+  print_header ();
+  for (i = 0; i < samples; i++)
+    {
+      volatile int j;
+      char label[16];
+
+      for (j = 0; j < DELAY_LOOPS; j++)
+        continue;
+      sample (&cur);
+      snprintf (label, sizeof label, "%d", i + 1);
+      print_delta (label, &cur, &prev);
+      prev = cur;
+    }
+
+  wait (pid);
+  sample (&cur);
+  print_delta ("rest", &cur, &prev);
+  print_delta ("total", &cur, &start);
+  return EXIT_SUCCESS;
+}
@@ -1,34 +1,235 @@
 #include "filesys/cache.h"
+#include <debug.h>
 #include <list.h>
 #include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stddef.h>
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <cache-stats.h>
+#include "devices/timer.h"
+#include "filesys/free-map.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Maximum read-ahead window, in sectors.  Zero disables
+   read-ahead.  Set with the -ra-max kernel option. */
+int cache_readahead_max = READAHEAD_MAX;
+
+/* Timer ticks between write-behind passes of the flusher
+   thread.  Zero disables the flusher, so that dirty blocks are
+   only written back on eviction or cache_flush().  Set with the
+   -flush-ticks kernel option. */
+int cache_flush_interval = FLUSH_INTERVAL;
+
+/* Most dirty sectors written back together in one request when
+   a dirty block is evicted or flushed.  1 writes each block on
+   its own.  Set with the -cluster kernel option, and limited to
+   CLUSTER_LIMIT. */
+int cache_cluster_max = CLUSTER_MAX;
+
+/* Size of the cache, in sectors, set with the -cache-size
+   kernel option.  Rounded up to a whole number of pages. */
+int cache_size = CACHE_DEFAULT_SIZE;
+
+/* If nonzero, overrides cache_size with this percentage of the
+   kernel pool.  Set with the -cache-pct kernel option. */
+int cache_pct;
 
 #ifdef ENABLE_CACHE
 
-struct block *fs_device = NULL;
+/* Protects cache_hash, the replacement policy's data and the
+   SECTOR, VALID, PIN_CNT and DIRTY members of every cache
+   block.  It is held only for lookup and victim selection,
+   never across disk I/O. */
+static struct lock cache_lock;
 
-struct list cache_list;
+/* Signaled whenever a cache block's pin count drops to zero. */
+static struct condition cache_unpinned;
 
 struct hash cache_hash;
 
+/* Sectors of cache data per page of cache_arena. */
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* The cache never shrinks below this many pages. */
+#define CACHE_MIN_PAGES 2
+
+/* Cache data, CACHE_CNT sectors in page-aligned memory from the
+   kernel pool.  The data for cache_blocks[i] is at
+   cache_arena + i * BLOCK_SECTOR_SIZE.  cache_reclaim() returns
+   pages to the pool from the end. */
+static uint8_t *cache_arena;
+
+/* Metadata for each sector of cache_arena, in a separate array
+   so that the data stays page aligned.  Also gives a fixed
+   order for cache_flush(). */
+static struct cache_block *cache_blocks;
+
+/* Number of cache blocks in use, always a multiple of
+   SECTORS_PER_PAGE, and the number allocated at boot.
+   cache_cnt is protected by cache_lock. */
+static size_t cache_cnt;
+static size_t cache_max_cnt;
+
+/* Pages given back by cache_reclaim().  Protected by
+   cache_lock. */
+static long long reclaim_cnt;
+
+/* A block device with sectors in the cache. */
+struct cache_device
+  {
+    struct block *block;        /* The device. */
+    size_t cnt;                 /* Number of cache blocks it holds. */
+    int quota_pct;              /* Most of the cache it may hold, in %. */
+  };
+
+/* Identifies a cached sector. */
+struct cache_key
+  {
+    struct cache_device *device;
+    block_sector_t sector;
+  };
+
+/* Devices that have used the cache, in order of first use.
+   Protected by cache_lock. */
+#define CACHE_DEVICE_CNT 8
+static struct cache_device cache_devices[CACHE_DEVICE_CNT];
+static int cache_device_cnt;
+
+/* Sectors queued for the read-ahead thread, as a ring buffer.
+   Protected by readahead_lock. */
+#define READAHEAD_QUEUE_SIZE 64
+
+/* Most queued sectors the read-ahead thread reads at once. */
+#define READAHEAD_BATCH 16
+struct readahead_request
+  {
+    struct block *block;
+    block_sector_t sector;
+  };
+static struct readahead_request readahead_queue[READAHEAD_QUEUE_SIZE];
+static int readahead_head;
+static int readahead_cnt;
+static struct lock readahead_lock;
+static struct condition readahead_nonempty;
+
+/* Read-ahead statistics.  Protected by cache_lock. */
+static long long readahead_issue_cnt;   /* Sectors read ahead. */
+static long long readahead_hit_cnt;     /* ...later used by a reader. */
+static long long readahead_waste_cnt;   /* ...evicted without use. */
+
+static thread_func readahead_thread;
+
+/* Number of dirty cache blocks.  Protected by cache_lock. */
+static int dirty_cnt;
+
+/* Set, and flush_wanted signaled, to wake the flusher: every
+   cache_flush_interval ticks, or early when dirty_cnt crosses
+   FLUSH_DIRTY_PCT percent of the cache.  Protected by
+   cache_lock. */
+static bool flush_requested;
+static struct condition flush_wanted;
+
+static thread_func flusher_thread, flush_timer_thread;
+
+/* Lookup statistics, not counting read-ahead.  Protected by
+   cache_lock. */
+static long long hit_cnt;               /* Sector found in cache. */
+static long long miss_cnt;              /* Sector read from disk. */
+static long long rmw_cnt;               /* CACHE_WRITE requests. */
+
+/* Dirty blocks written back, for any reason.  Protected by
+   cache_lock. */
+static long long write_back_cnt;
+
+/* Eviction statistics.  Protected by cache_lock. */
+static long long evict_cnt;             /* Valid blocks evicted. */
+static long long evict_dirty_cnt;       /* ...that had to be written. */
+static uint64_t evict_cycles;           /* Total cycles spent evicting. */
+
 struct cache_block
   {
-    struct list_elem list_elem;
+    struct list_elem list_elem; /* Owned by the replacement policy. */
     struct hash_elem hash_elem;
+    int queue;                  /* Owned by the replacement policy. */
 
+    struct cache_device *device;
     block_sector_t sector;
-    uint8_t data[BLOCK_SECTOR_SIZE];
+    uint8_t *data;              /* BLOCK_SECTOR_SIZE bytes in cache_arena. */
+
+    bool valid;                 /* In cache_hash, holding DEVICE's SECTOR? */
+    int pin_cnt;                /* Threads using or waiting for DATA. */
+    bool readahead;             /* Read ahead, not yet used? */
+
+    struct rwlock rw;           /* Guards DATA. */
+    bool dirty;                 /* Must DATA be written back? */
+    struct cache_owner *owner;  /* Dirty list we are on, if any. */
+    struct list_elem owner_elem; /* Element in OWNER's dirty list. */
+  };
+
+/* A cache replacement policy.  Every function is called with
+   cache_lock held. */
+struct cache_policy
+  {
+    const char *name;           /* Name for -cache-policy option. */
+
+    /* Initializes the policy's data structures. */
+    void (*init) (void);
+
+    /* Takes charge of BLOCK, which holds no sector yet. */
+    void (*add) (struct cache_block *block);
+
+    /* Notes that BLOCK was found by a lookup. */
+    void (*hit) (struct cache_block *block);
+
+    /* Returns an unpinned block to evict, or a null pointer if
+       every block is pinned.  If DEVICE is nonnull, only blocks
+       holding DEVICE's sectors are considered. */
+    struct cache_block *(*victim) (struct cache_device *device);
+
+    /* Notes that BLOCK, returned by victim(), is about to be
+       reused to hold DEVICE's SECTOR.  BLOCK's DEVICE, SECTOR
+       and VALID members still describe its old contents. */
+    void (*replace) (struct cache_block *block,
+                     struct cache_device *device, block_sector_t sector);
+
+    /* Gives up BLOCK, which is unpinned, because its memory is
+       being returned to the page allocator. */
+    void (*remove) (struct cache_block *block);
+  };
+
+static const struct cache_policy lru_policy;
+static const struct cache_policy twoq_policy;
 
-    bool dirty;
+/* Available replacement policies, the default first. */
+static const struct cache_policy *const cache_policies[] =
+  {
+    &lru_policy,
+    &twoq_policy,
   };
 
+/* The replacement policy in use. */
+static const struct cache_policy *cache_policy = &lru_policy;
+
+static palloc_reclaim_func cache_reclaim;
+
+/* Returns the cache block whose data is at DATA. */
+#define data_to_cache_block(DATA)                                       \
+        (&cache_blocks[((uint8_t *) (DATA) - cache_arena)               \
+                       / BLOCK_SECTOR_SIZE])
+
 unsigned
 hash_func (const struct hash_elem *e, void *aux)
 {
   const struct cache_block *block = hash_entry (e, struct cache_block, hash_elem);
-  return block->sector;
+  return hash_int (block->sector) ^ hash_bytes (&block->device,
+                                                sizeof block->device);
 }
 
 bool
@@ -36,123 +237,1430 @@ hash_neq_func (const struct hash_elem *a, const struct hash_elem *b, void *aux)
 {
   const struct cache_block *a_block = hash_entry (a, struct cache_block, hash_elem);
   const struct cache_block *b_block = hash_entry (b, struct cache_block, hash_elem);
-  return a_block->sector != b_block->sector;
+  return (a_block->device != b_block->device
+          || a_block->sector != b_block->sector);
 }
 
+/* Allocates the cache's memory, sized by cache_pct or
+   cache_size, and starts its threads. */
 void
 cache_init (void)
 {
-  list_init (&cache_list);
+  size_t page_cnt;
+  size_t i;
+
+  if (cache_pct > 0)
+    page_cnt = palloc_kernel_page_cnt () * cache_pct / 100;
+  else
+    page_cnt = DIV_ROUND_UP (cache_size, SECTORS_PER_PAGE);
+  if (page_cnt < CACHE_MIN_PAGES)
+    page_cnt = CACHE_MIN_PAGES;
+  if (cache_cluster_max < 1)
+    cache_cluster_max = 1;
+  else if (cache_cluster_max > CLUSTER_LIMIT)
+    cache_cluster_max = CLUSTER_LIMIT;
+
+  cache_max_cnt = cache_cnt = page_cnt * SECTORS_PER_PAGE;
+  cache_arena = palloc_get_multiple (PAL_ASSERT, page_cnt);
+  cache_blocks = malloc (cache_cnt * sizeof *cache_blocks);
+  if (cache_blocks == NULL)
+    PANIC ("out of memory for %zu cache blocks", cache_cnt);
+
+  lock_init (&cache_lock);
+  cond_init (&cache_unpinned);
+  cache_policy->init ();
   hash_init (&cache_hash, hash_func, hash_neq_func, NULL);
-  for (int i = 0; i < CACHE_SIZE; i++)
+  for (i = 0; i < cache_cnt; i++)
     {
-      struct cache_block *block = malloc (sizeof (struct cache_block));
+      struct cache_block *block = &cache_blocks[i];
+      block->data = cache_arena + i * BLOCK_SECTOR_SIZE;
       block->dirty = false;
+      block->valid = false;
+      block->pin_cnt = 0;
+      block->readahead = false;
+      block->owner = NULL;
+      block->device = NULL;
       block->sector = -1;
-      list_push_front (&cache_list, &block->list_elem);
+      rwlock_init (&block->rw);
+      cache_policy->add (block);
     }
-}
+  palloc_set_reclaim_hook (cache_reclaim);
 
-static void
-cache_out (struct cache_block *cache_block)
-{
-  ASSERT (fs_device != NULL);
-  if (hash_find (&cache_hash, &cache_block->hash_elem))
+  lock_init (&readahead_lock);
+  cond_init (&readahead_nonempty);
+  thread_create ("readahead", PRI_DEFAULT, readahead_thread, NULL);
+  cond_init (&flush_wanted);
+  if (cache_flush_interval > 0)
     {
-      if (cache_block->dirty)
-        block_write (fs_device, cache_block->sector, cache_block->data);
-      hash_delete (&cache_hash, &cache_block->hash_elem);
+      thread_create ("flusher", PRI_DEFAULT, flusher_thread, NULL);
+      thread_create ("flush-timer", PRI_DEFAULT, flush_timer_thread, NULL);
     }
 }
 
-void
-cache_read (struct block *block, block_sector_t sector, void *buffer)
+/* Returns the cache's record of BLOCK, creating it on first
+   use.  The file system device may fill the whole cache; other
+   devices, such as scratch and swap, are held to
+   CACHE_DEVICE_QUOTA_PCT percent of it, so that copying to or
+   from them cannot push out all the file system's blocks.
+   cache_lock must be held. */
+static struct cache_device *
+cache_device (struct block *block)
 {
-  if (!fs_device)
-    fs_device = block;
-  ASSERT (fs_device == block);
+  struct cache_device *d;
 
-  struct cache_block *cache_block;
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (d = cache_devices; d < cache_devices + cache_device_cnt; d++)
+    if (d->block == block)
+      return d;
+
+  if (cache_device_cnt >= CACHE_DEVICE_CNT)
+    PANIC ("too many block devices in the buffer cache");
+  d = &cache_devices[cache_device_cnt++];
+  d->block = block;
+  d->cnt = 0;
+  d->quota_pct = (block_type (block) == BLOCK_FILESYS
+                  ? 100 : CACHE_DEVICE_QUOTA_PCT);
+  return d;
+}
+
+/* Returns true if DEVICE holds as much of the cache as its
+   quota allows.  cache_lock must be held. */
+static bool
+cache_device_full (const struct cache_device *device)
+{
+  return device->cnt * 100 >= cache_cnt * device->quota_pct;
+}
+
+/* Returns the cache block holding DEVICE's SECTOR, or a null
+   pointer if it is not cached.  cache_lock must be held. */
+static struct cache_block *
+cache_lookup (struct cache_device *device, block_sector_t sector)
+{
   struct cache_block search_block;
   struct hash_elem *h;
 
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  search_block.device = device;
   search_block.sector = sector;
   h = hash_find (&cache_hash, &search_block.hash_elem);
+  return h != NULL ? hash_entry (h, struct cache_block, hash_elem) : NULL;
+}
+
+/* Least recently used replacement.
+
+   Every block is on a single list, most recently used first,
+   and the victim is the unpinned block closest to the end.  A
+   long sequential scan flushes everything else out of the
+   cache. */
+
+/* Cache blocks, most recently used first. */
+static struct list lru_list;
+
+static void
+lru_init (void)
+{
+  list_init (&lru_list);
+}
+
+static void
+lru_add (struct cache_block *cache_block)
+{
+  list_push_back (&lru_list, &cache_block->list_elem);
+}
+
+/* Moves CACHE_BLOCK to the most recently used end of
+   lru_list. */
+static void
+lru_touch (struct cache_block *cache_block)
+{
+  list_remove (&cache_block->list_elem);
+  list_push_front (&lru_list, &cache_block->list_elem);
+}
+
+/* Returns the last block on LIST, searching backward, that
+   nobody has pinned, or a null pointer if there is none.  If
+   DEVICE is nonnull, only considers DEVICE's blocks. */
+static struct cache_block *
+last_unpinned (struct list *list, struct cache_device *device)
+{
+  struct list_elem *e;
+
+  for (e = list_rbegin (list); e != list_rend (list); e = list_prev (e))
+    {
+      struct cache_block *cache_block = list_entry (e, struct cache_block, list_elem);
+      if (cache_block->pin_cnt == 0
+          && (device == NULL || cache_block->device == device))
+        return cache_block;
+    }
+  return NULL;
+}
+
+static struct cache_block *
+lru_victim (struct cache_device *device)
+{
+  return last_unpinned (&lru_list, device);
+}
+
+static void
+lru_replace (struct cache_block *cache_block,
+             struct cache_device *device UNUSED,
+             block_sector_t sector UNUSED)
+{
+  lru_touch (cache_block);
+}
+
+static void
+lru_remove (struct cache_block *cache_block)
+{
+  list_remove (&cache_block->list_elem);
+}
+
+static const struct cache_policy lru_policy =
+  {
+    "lru",
+    lru_init,
+    lru_add,
+    lru_touch,
+    lru_victim,
+    lru_replace,
+    lru_remove,
+  };
+
+/* 2Q replacement (Johnson and Shasha, VLDB 1994).
+
+   A block brought in for the first time goes on the FIFO queue
+   A1in.  Hits there do not promote it, so a block touched only
+   by one pass of a scan leaves the cache quickly.  Blocks
+   evicted from A1in have their sector number remembered on the
+   "ghost" queue A1out; a miss on a sector found there shows it
+   is reused over a longer span, so it goes on the LRU queue Am,
+   which only other Am blocks and A1in overflow compete with. */
+
+/* Values for the QUEUE member of a cache block. */
+enum twoq_queue
+  {
+    TWOQ_A1IN,                  /* On twoq_a1in. */
+    TWOQ_AM                     /* On twoq_am. */
+  };
+
+/* Target size of A1in, in blocks, as the paper recommends, and
+   size of A1out, in sector numbers.  The paper suggests half
+   the cache for A1out, but a small cache would let a scan push
+   a hot sector out of A1out before its next use; remembering
+   more sector numbers costs only a few bytes each. */
+#define TWOQ_KIN (cache_cnt / 4)
+#define TWOQ_KOUT (cache_max_cnt * 2)
+
+static struct list twoq_a1in;   /* Newest first. */
+static int twoq_a1in_cnt;       /* Number of blocks on twoq_a1in. */
+static struct list twoq_am;     /* Most recently used first. */
+
+/* An entry in A1out. */
+struct twoq_ghost
+  {
+    struct hash_elem hash_elem; /* In twoq_ghosts, if LIVE. */
+    struct cache_key key;       /* Sector remembered. */
+    bool live;                  /* False once a miss has claimed it. */
+  };
+
+/* A1out, a ring buffer of entries, oldest at twoq_a1out_head.
+   A miss finds its sector through twoq_ghosts, which holds the
+   live entries, and leaves a dead entry behind in the ring
+   rather than closing the gap, so that both take constant
+   time. */
+static struct twoq_ghost *twoq_a1out;
+static size_t twoq_a1out_head;
+static size_t twoq_a1out_cnt;
+static struct hash twoq_ghosts;
+
+static unsigned
+twoq_ghost_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct twoq_ghost *g = hash_entry (e, struct twoq_ghost, hash_elem);
+  return hash_int (g->key.sector) ^ hash_bytes (&g->key.device,
+                                                sizeof g->key.device);
+}
+
+static bool
+twoq_ghost_less (const struct hash_elem *a_, const struct hash_elem *b_,
+                 void *aux UNUSED)
+{
+  const struct twoq_ghost *a = hash_entry (a_, struct twoq_ghost, hash_elem);
+  const struct twoq_ghost *b = hash_entry (b_, struct twoq_ghost, hash_elem);
+  if (a->key.device != b->key.device)
+    return a->key.device < b->key.device;
+  return a->key.sector < b->key.sector;
+}
+
+static void
+twoq_init (void)
+{
+  list_init (&twoq_a1in);
+  list_init (&twoq_am);
+  twoq_a1in_cnt = 0;
+  twoq_a1out = malloc (TWOQ_KOUT * sizeof *twoq_a1out);
+  if (twoq_a1out == NULL
+      || !hash_init (&twoq_ghosts, twoq_ghost_hash, twoq_ghost_less, NULL))
+    PANIC ("out of memory for 2Q ghost queue");
+  twoq_a1out_head = twoq_a1out_cnt = 0;
+}
+
+static void
+twoq_add (struct cache_block *cache_block)
+{
+  cache_block->queue = TWOQ_A1IN;
+  list_push_back (&twoq_a1in, &cache_block->list_elem);
+  twoq_a1in_cnt++;
+}
 
-  if (h != NULL)
+static void
+twoq_hit (struct cache_block *cache_block)
+{
+  if (cache_block->queue == TWOQ_AM)
     {
-      cache_block = hash_entry (h, struct cache_block, hash_elem);
+      list_remove (&cache_block->list_elem);
+      list_push_front (&twoq_am, &cache_block->list_elem);
+    }
+}
+
+static struct cache_block *
+twoq_victim (struct cache_device *device)
+{
+  struct cache_block *cache_block = NULL;
+
+  if ((size_t) twoq_a1in_cnt > TWOQ_KIN)
+    cache_block = last_unpinned (&twoq_a1in, device);
+  if (cache_block == NULL)
+    cache_block = last_unpinned (&twoq_am, device);
+  if (cache_block == NULL)
+    cache_block = last_unpinned (&twoq_a1in, device);
+  return cache_block;
+}
+
+/* Removes DEVICE's SECTOR from A1out and returns true, or
+   returns false if it is not there.  Its entry stays in the
+   ring, dead, until it becomes the oldest. */
+static bool
+twoq_ghost_remove (struct cache_device *device, block_sector_t sector)
+{
+  struct twoq_ghost search;
+  struct hash_elem *e;
+
+  search.key.device = device;
+  search.key.sector = sector;
+  e = hash_delete (&twoq_ghosts, &search.hash_elem);
+  if (e == NULL)
+    return false;
+  hash_entry (e, struct twoq_ghost, hash_elem)->live = false;
+  return true;
+}
+
+/* Adds DEVICE's SECTOR to A1out, forgetting the oldest entry if
+   it is full. */
+static void
+twoq_ghost_add (struct cache_device *device, block_sector_t sector)
+{
+  struct twoq_ghost *g;
+  struct hash_elem *old;
+
+  if (twoq_a1out_cnt == TWOQ_KOUT)
+    {
+      g = &twoq_a1out[twoq_a1out_head];
+      if (g->live)
+        hash_delete (&twoq_ghosts, &g->hash_elem);
+      twoq_a1out_head = (twoq_a1out_head + 1) % TWOQ_KOUT;
+      twoq_a1out_cnt--;
+    }
+  g = &twoq_a1out[(twoq_a1out_head + twoq_a1out_cnt) % TWOQ_KOUT];
+  g->key.device = device;
+  g->key.sector = sector;
+  g->live = true;
+  old = hash_replace (&twoq_ghosts, &g->hash_elem);
+  if (old != NULL)
+    hash_entry (old, struct twoq_ghost, hash_elem)->live = false;
+  twoq_a1out_cnt++;
+}
+
+static void
+twoq_replace (struct cache_block *cache_block,
+              struct cache_device *device, block_sector_t sector)
+{
+  list_remove (&cache_block->list_elem);
+  if (cache_block->queue == TWOQ_A1IN)
+    {
+      twoq_a1in_cnt--;
+      if (cache_block->valid)
+        twoq_ghost_add (cache_block->device, cache_block->sector);
+    }
+
+  if (twoq_ghost_remove (device, sector))
+    {
+      cache_block->queue = TWOQ_AM;
+      list_push_front (&twoq_am, &cache_block->list_elem);
     }
   else
     {
-      struct list_elem *e;
-      e = list_rbegin (&cache_list);
-      cache_block = list_entry (e, struct cache_block, list_elem);
-      cache_out (cache_block);
-      block_read (block, sector, cache_block->data);
+      cache_block->queue = TWOQ_A1IN;
+      list_push_front (&twoq_a1in, &cache_block->list_elem);
+      twoq_a1in_cnt++;
+    }
+}
+
+static void
+twoq_remove (struct cache_block *cache_block)
+{
+  list_remove (&cache_block->list_elem);
+  if (cache_block->queue == TWOQ_A1IN)
+    twoq_a1in_cnt--;
+}
+
+static const struct cache_policy twoq_policy =
+  {
+    "2q",
+    twoq_init,
+    twoq_add,
+    twoq_hit,
+    twoq_victim,
+    twoq_replace,
+    twoq_remove,
+  };
+
+/* Selects the replacement policy named NAME.  Must be called
+   before cache_init().  Returns false if there is no such
+   policy. */
+bool
+cache_set_policy (const char *name)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof cache_policies / sizeof *cache_policies; i++)
+    if (!strcmp (cache_policies[i]->name, name))
+      {
+        cache_policy = cache_policies[i];
+        return true;
+      }
+  return false;
+}
+
+/* Drops one pin from CACHE_BLOCK.  cache_lock must be held. */
+static void
+cache_unpin (struct cache_block *cache_block)
+{
+  ASSERT (cache_block->pin_cnt > 0);
+  if (--cache_block->pin_cnt == 0)
+    cond_signal (&cache_unpinned, &cache_lock);
+}
+
+/* Wakes the flusher, if it is not already due to run.
+   cache_lock must be held. */
+static void
+cache_request_flush (void)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  if (!flush_requested)
+    {
+      flush_requested = true;
+      cond_signal (&flush_wanted, &cache_lock);
+    }
+}
+
+/* Marks CACHE_BLOCK dirty and wakes the flusher if too much of
+   the cache has become dirty.  cache_lock must be held. */
+static void
+cache_mark_dirty (struct cache_block *cache_block)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  if (!cache_block->dirty)
+    {
+      cache_block->dirty = true;
+      if ((size_t) ++dirty_cnt * 100 > cache_cnt * FLUSH_DIRTY_PCT)
+        cache_request_flush ();
+    }
+}
+
+/* Runs that cache_write_sorted() keeps in flight at once. */
+#define WRITE_WINDOW 4
+
+/* A run of blocks being written back. */
+struct cache_run
+  {
+    struct cache_block **blocks;        /* Consecutive sectors, ascending. */
+    size_t cnt;                         /* Number of blocks. */
+    size_t first, last;                 /* Range actually written. */
+    void *buffers[CLUSTER_LIMIT];       /* Data of blocks FIRST...LAST. */
+    struct block_request request;
+  };
+
+/* Starts writing back the CNT blocks in BLOCKS, which hold
+   consecutive sectors of one device in ascending order, as a
+   single request, with RUN to keep track of it.  Clean blocks at
+   either end are left out; clean blocks in the middle are
+   written again, which is harmless and cheaper than a second
+   request.  Takes the blocks' rw locks for reading, in order,
+   which keeps writers out until cache_run_finish().  The caller
+   must have pinned every block and must not hold cache_lock. */
+static void
+cache_run_start (struct cache_run *run, struct cache_block **blocks,
+                 size_t cnt)
+{
+  size_t i;
+
+  ASSERT (cnt <= CLUSTER_LIMIT);
+
+  run->blocks = blocks;
+  run->cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    rwlock_acquire_read (&blocks[i]->rw);
+
+  lock_acquire (&cache_lock);
+  for (run->first = 0; run->first < cnt && !blocks[run->first]->dirty;
+       run->first++)
+    continue;
+  for (run->last = cnt; run->last > run->first && !blocks[run->last - 1]->dirty;
+       run->last--)
+    continue;
+  lock_release (&cache_lock);
+  if (run->first == run->last)
+    return;
+
+  for (i = run->first; i < run->last; i++)
+    run->buffers[i - run->first] = blocks[i]->data;
+  run->request.write = true;
+  run->request.sector = blocks[run->first]->sector;
+  run->request.cnt = run->last - run->first;
+  run->request.buffer = NULL;
+  run->request.buffers = run->buffers;
+  run->request.complete = NULL;
+  block_submit (blocks[run->first]->device->block, &run->request);
+}
+
+/* Waits for RUN, started with cache_run_start(), to reach the
+   disk, marks its blocks clean, and drops their rw locks. */
+static void
+cache_run_finish (struct cache_run *run)
+{
+  size_t i;
+
+  if (run->first < run->last)
+    {
+      block_wait (&run->request);
+
+      lock_acquire (&cache_lock);
+      for (i = run->first; i < run->last; i++)
+        {
+          struct cache_block *cache_block = run->blocks[i];
+          write_back_cnt++;
+          if (cache_block->dirty)
+            {
+              cache_block->dirty = false;
+              dirty_cnt--;
+              if (cache_block->owner != NULL)
+                {
+                  list_remove (&cache_block->owner_elem);
+                  cache_block->owner = NULL;
+                }
+            }
+        }
+      lock_release (&cache_lock);
+    }
+  for (i = 0; i < run->cnt; i++)
+    rwlock_release_read (&run->blocks[i]->rw);
+}
+
+/* Writes back the CNT pinned blocks in RUN, which hold
+   consecutive sectors of one device in ascending order, and
+   waits for them to reach the disk.  cache_lock must not be
+   held. */
+static void
+cache_write_run (struct cache_block *run[], size_t cnt)
+{
+  struct cache_run r;
+
+  cache_run_start (&r, run, cnt);
+  cache_run_finish (&r);
+}
+
+/* Returns the block holding DEVICE's SECTOR if it is cached and
+   dirty, otherwise a null pointer.  cache_lock must be held. */
+static struct cache_block *
+cache_dirty_neighbor (struct cache_device *device, block_sector_t sector)
+{
+  struct cache_block *cache_block = cache_lookup (device, sector);
+  return cache_block != NULL && cache_block->dirty ? cache_block : NULL;
+}
+
+/* Stores into RUN, in ascending sector order, dirty VICTIM and
+   the dirty blocks holding the sectors around it on the same
+   device, up to cache_cluster_max blocks in all, and pins each
+   of them.  Returns the number of blocks stored.  cache_lock
+   must be held. */
+static size_t
+cache_gather_run (struct cache_block *victim, struct cache_block *run[])
+{
+  struct cache_device *device = victim->device;
+  block_sector_t sector = victim->sector;
+  size_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (victim->dirty);
+
+  /* Find where the run starts. */
+  for (cnt = 1; cnt < (size_t) cache_cluster_max && sector > 0; cnt++)
+    if (cache_dirty_neighbor (device, sector - 1) != NULL)
+      sector--;
+    else
+      break;
+
+  /* Collect it. */
+  for (cnt = 0; cnt < (size_t) cache_cluster_max; cnt++, sector++)
+    {
+      struct cache_block *cache_block
+        = (sector == victim->sector ? victim
+           : cache_dirty_neighbor (device, sector));
+      if (cache_block == NULL)
+        break;
+      cache_block->pin_cnt++;
+      run[cnt] = cache_block;
+    }
+  return cnt;
+}
+
+/* How cache_acquire() is being used. */
+enum acquire_kind
+  {
+    ACQUIRE_GET,                /* For cache_get() and the like. */
+    ACQUIRE_CLAIM,              /* To read an uncached sector in. */
+    ACQUIRE_READAHEAD           /* The same, by the read-ahead thread. */
+  };
+
+/* Returns the cache block for BLOCK's SECTOR, pinned and with
+   its rw lock held for writing if EXCLUSIVE is true or for
+   reading otherwise.  On a miss, evicts the block chosen by the
+   replacement policy; if FILL is true the new block is then read
+   from disk, otherwise the caller promises to overwrite all of
+   its data.  FILL may only be false if EXCLUSIVE is true.
+
+   If KIND is ACQUIRE_CLAIM or ACQUIRE_READAHEAD, the caller
+   only wants to claim a block for SECTOR, to read it in itself:
+   returns a null pointer instead of waiting if SECTOR is already
+   cached or every block is pinned.  A claim by the read-ahead
+   thread counts as read-ahead rather than as a miss.
+
+   Disk I/O happens without cache_lock held, so lookups of other
+   sectors proceed while this thread waits on the disk. */
+static struct cache_block *
+cache_acquire (struct block *block, block_sector_t sector,
+               bool exclusive, bool fill, enum acquire_kind kind)
+{
+  struct cache_device *device;
+  struct cache_block *cache_block;
+  bool claim = kind != ACQUIRE_GET;
+  bool readahead = kind == ACQUIRE_READAHEAD;
+  uint64_t start = 0;
+
+  ASSERT (exclusive || fill);
+
+  lock_acquire (&cache_lock);
+  device = cache_device (block);
+  for (;;)
+    {
+      cache_block = cache_lookup (device, sector);
+      if (cache_block != NULL && claim)
+        {
+          lock_release (&cache_lock);
+          return NULL;
+        }
+      else if (cache_block != NULL)
+        {
+          /* Hit.  If another thread is still reading the sector
+             in, it holds the rw lock for writing, so we wait
+             for it below. */
+          if (cache_block->readahead)
+            {
+              readahead_hit_cnt++;
+              cache_block->readahead = false;
+            }
+          hit_cnt++;
+          cache_block->pin_cnt++;
+          cache_policy->hit (cache_block);
+          lock_release (&cache_lock);
+          if (exclusive)
+            rwlock_acquire_write (&cache_block->rw);
+          else
+            rwlock_acquire_read (&cache_block->rw);
+          return cache_block;
+        }
+
+      /* A device at its quota replaces one of its own blocks,
+         if it can. */
+      cache_block = NULL;
+      if (cache_device_full (device))
+        cache_block = cache_policy->victim (device);
+      if (cache_block == NULL)
+        cache_block = cache_policy->victim (NULL);
+      if (cache_block == NULL && claim)
+        {
+          lock_release (&cache_lock);
+          return NULL;
+        }
+      else if (cache_block == NULL)
+        {
+          cond_wait (&cache_unpinned, &cache_lock);
+          continue;
+        }
+
+      if (start == 0 && cache_block->valid)
+        start = timer_cycles ();
+      if (cache_block->dirty)
+        {
+          struct cache_block *run[CLUSTER_LIMIT];
+          size_t run_cnt, i;
+
+          if (start != 0)
+            evict_dirty_cnt++;
+          /* Write the victim back, along with its dirty
+             neighbors, while it is still findable under its old
+             sector, so that nobody can read a stale copy from
+             disk in the meantime.  Then start over, since the
+             world may have changed. */
+          run_cnt = cache_gather_run (cache_block, run);
+          lock_release (&cache_lock);
+          cache_write_run (run, run_cnt);
+          lock_acquire (&cache_lock);
+          for (i = 0; i < run_cnt; i++)
+            cache_unpin (run[i]);
+          continue;
+        }
+      if (start != 0)
+        {
+          evict_cnt++;
+          evict_cycles += timer_cycles () - start;
+        }
+
+      /* Clean and unpinned: take it over.  Nobody holds its rw
+         lock, so acquiring it cannot block. */
+      cache_policy->replace (cache_block, device, sector);
+      if (cache_block->valid)
+        {
+          hash_delete (&cache_hash, &cache_block->hash_elem);
+          cache_block->device->cnt--;
+        }
+      if (cache_block->readahead)
+        readahead_waste_cnt++;
+      cache_block->device = device;
       cache_block->sector = sector;
-      cache_block->dirty = false;
+      device->cnt++;
+      cache_block->valid = true;
+      cache_block->readahead = readahead;
+      if (readahead)
+        readahead_issue_cnt++;
+      else
+        miss_cnt++;
       hash_insert (&cache_hash, &cache_block->hash_elem);
+      cache_block->pin_cnt++;
+      rwlock_acquire_write (&cache_block->rw);
+      lock_release (&cache_lock);
+
+      if (fill)
+        block_read (block, sector, cache_block->data);
+      if (!exclusive)
+        {
+          rwlock_release_write (&cache_block->rw);
+          rwlock_acquire_read (&cache_block->rw);
+        }
+      return cache_block;
     }
+}
 
-  list_remove (&cache_block->list_elem);
-  list_push_front (&cache_list, &cache_block->list_elem);
-  memcpy (buffer, cache_block->data, BLOCK_SECTOR_SIZE);
+/* Releases CACHE_BLOCK, obtained from cache_acquire() with the
+   same EXCLUSIVE argument.  If DIRTY is true, the caller has
+   modified the block's data, which requires EXCLUSIVE, and the
+   block goes on OWNER's dirty list if OWNER is non-null. */
+static void
+cache_release (struct cache_block *cache_block, bool exclusive, bool dirty,
+               struct cache_owner *owner)
+{
+  ASSERT (exclusive || !dirty);
+
+  lock_acquire (&cache_lock);
+  if (dirty)
+    {
+      cache_mark_dirty (cache_block);
+      if (owner != NULL && cache_block->owner != owner)
+        {
+          if (cache_block->owner != NULL)
+            list_remove (&cache_block->owner_elem);
+          cache_block->owner = owner;
+          list_push_back (&owner->dirty, &cache_block->owner_elem);
+        }
+    }
+  if (exclusive)
+    rwlock_release_write (&cache_block->rw);
+  else
+    rwlock_release_read (&cache_block->rw);
+  cache_unpin (cache_block);
+  lock_release (&cache_lock);
+}
+
+/* Pins SECTOR of BLOCK in the cache and returns a pointer to
+   its BLOCK_SECTOR_SIZE bytes of data, which stays valid until
+   the matching cache_put().  With CACHE_READ the data may only
+   be read, and other readers may share it.  With CACHE_WRITE
+   and CACHE_OVERWRITE the caller has the sector to itself and
+   may modify it; CACHE_OVERWRITE skips reading the old contents
+   from disk, so the caller must overwrite all of them.
+
+   A thread must not hold more than one sector at a time, since
+   two threads doing so could deadlock. */
+void *
+cache_get (struct block *block, block_sector_t sector, enum cache_mode mode)
+{
+  if (mode == CACHE_WRITE)
+    {
+      lock_acquire (&cache_lock);
+      rmw_cnt++;
+      lock_release (&cache_lock);
+    }
+
+  struct cache_block *cache_block
+    = cache_acquire (block, sector, mode != CACHE_READ,
+                     mode != CACHE_OVERWRITE, ACQUIRE_GET);
+  return cache_block->data;
+}
+
+/* Releases DATA, obtained from cache_get().  If it was obtained
+   for writing, it is marked dirty. */
+void
+cache_put (void *data)
+{
+  struct cache_block *cache_block = data_to_cache_block (data);
+  bool exclusive = rwlock_held_for_write (&cache_block->rw);
+  cache_release (cache_block, exclusive, exclusive, NULL);
+}
+
+/* Like cache_put(), but if DATA was obtained for writing it
+   also goes on OWNER's dirty list, for cache_sync(). */
+void
+cache_put_owned (void *data, struct cache_owner *owner)
+{
+  struct cache_block *cache_block = data_to_cache_block (data);
+  bool exclusive = rwlock_held_for_write (&cache_block->rw);
+  cache_release (cache_block, exclusive, exclusive, owner);
+}
+
+void
+cache_read (struct block *block, block_sector_t sector, void *buffer)
+{
+  void *data = cache_get (block, sector, CACHE_READ);
+  memcpy (buffer, data, BLOCK_SECTOR_SIZE);
+  cache_put (data);
 }
 
 void
 cache_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  if (!fs_device)
-    fs_device = block;
-  ASSERT (fs_device == block);
+  void *data = cache_get (block, sector, CACHE_OVERWRITE);
+  memcpy (data, buffer, BLOCK_SECTOR_SIZE);
+  cache_put (data);
+}
 
-  struct cache_block *cache_block;
-  struct cache_block search_block;
-  struct hash_elem *h;
+/* Most sectors cache_read_multiple() claims for one request. */
+#define READ_CLAIM_MAX 64
 
-  search_block.sector = sector;
-  h = hash_find (&cache_hash, &search_block.hash_elem);
+/* Reads the CNT sectors of BLOCK starting at SECTOR into BUFFER.
+   Sectors found in the cache are copied out of it.  For each run
+   of sectors that are not, claims a cache block apiece and fills
+   them all with a single request, as the read-ahead thread does,
+   then copies them out.  A run stops at READ_CLAIM_MAX sectors
+   or a quarter of the cache, whichever is less.
+
+   The data always passes through the cache, so BUFFER may be a
+   user buffer: block requests run in the device's I/O thread,
+   which cannot see user memory.
+
+   Like the read-ahead thread, this holds several blocks at once
+   while their read is in progress, which is safe for the same
+   reasons. */
+void
+cache_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      struct cache_block *blocks[READ_CLAIM_MAX];
+      void *buffers[READ_CLAIM_MAX];
+      struct block_request r;
+      size_t max_run, run, j;
+
+      lock_acquire (&cache_lock);
+      max_run = cache_cnt / 4 < READ_CLAIM_MAX ? cache_cnt / 4 : READ_CLAIM_MAX;
+      lock_release (&cache_lock);
+
+      for (run = 0; i + run < cnt && run < max_run; run++)
+        {
+          blocks[run] = cache_acquire (block, sector + i + run, true, false,
+                                       ACQUIRE_CLAIM);
+          if (blocks[run] == NULL)
+            break;
+          buffers[run] = blocks[run]->data;
+        }
+
+      if (run == 0)
+        {
+          cache_read (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+          i++;
+          continue;
+        }
 
-  if (h != NULL)
+      r.write = false;
+      r.sector = sector + i;
+      r.cnt = run;
+      r.buffer = NULL;
+      r.buffers = buffers;
+      r.complete = NULL;
+      block_submit (block, &r);
+      block_wait (&r);
+
+      for (j = 0; j < run; j++)
+        {
+          memcpy (buffer + (i + j) * BLOCK_SECTOR_SIZE, blocks[j]->data,
+                  BLOCK_SECTOR_SIZE);
+          cache_release (blocks[j], true, false, NULL);
+        }
+      i += run;
+    }
+}
+
+/* Writes the CNT sectors of BLOCK starting at SECTOR from BUFFER
+   into the cache and marks them dirty.  The flusher, eviction or
+   cache_flush() writes them back later, with adjacent sectors
+   clustered into single requests. */
+void
+cache_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer_, size_t cnt)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    cache_write (block, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Asks the read-ahead thread to bring SECTOR of BLOCK into the
+   cache in the background.  The request is dropped if the
+   read-ahead queue is full or already holds SECTOR. */
+void
+cache_readahead (struct block *block, block_sector_t sector)
+{
+  struct readahead_request *r;
+  int i;
+
+  lock_acquire (&readahead_lock);
+  for (i = 0; i < readahead_cnt; i++)
     {
-      cache_block = hash_entry (h, struct cache_block, hash_elem);
+      r = &readahead_queue[(readahead_head + i) % READAHEAD_QUEUE_SIZE];
+      if (r->block == block && r->sector == sector)
+        break;
     }
-  else
+  if (i == readahead_cnt && readahead_cnt < READAHEAD_QUEUE_SIZE)
     {
-      struct list_elem *e;
-      e = list_rbegin (&cache_list);
-      cache_block = list_entry (e, struct cache_block, list_elem);
-      cache_out (cache_block);
-      cache_block->sector = sector;
-      hash_insert (&cache_hash, &cache_block->hash_elem);
+      r = &readahead_queue[(readahead_head + readahead_cnt)
+                           % READAHEAD_QUEUE_SIZE];
+      r->block = block;
+      r->sector = sector;
+      readahead_cnt++;
+      cond_signal (&readahead_nonempty, &readahead_lock);
     }
+  lock_release (&readahead_lock);
+}
 
-  list_remove (&cache_block->list_elem);
-  list_push_front (&cache_list, &cache_block->list_elem);
-  memcpy (cache_block->data, buffer, BLOCK_SECTOR_SIZE);
-  cache_block->dirty = true;
+/* Read-ahead thread.  Takes up to READAHEAD_BATCH sectors
+   queued by cache_readahead() at a time, claims a cache block
+   for each that is not yet cached, and submits all the reads
+   before waiting for any, so that the block layer can sort and
+   merge them.
+
+   The thread holds the claimed blocks exclusively until their
+   reads finish, which bends the one-block-per-thread rule.  It
+   is safe because the blocks are clean and freshly claimed, so
+   nobody else holds them or waits for anything while holding
+   them, and cache_acquire() never makes the read-ahead thread
+   wait for a pinned block. */
+static void
+readahead_thread (void *aux UNUSED)
+{
+  static struct cache_block *blocks[READAHEAD_BATCH];
+  static struct block_request requests[READAHEAD_BATCH];
+
+  for (;;)
+    {
+      struct readahead_request batch[READAHEAD_BATCH];
+      int batch_cnt, block_cnt, i;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_cnt == 0)
+        cond_wait (&readahead_nonempty, &readahead_lock);
+      for (batch_cnt = 0; batch_cnt < READAHEAD_BATCH && readahead_cnt > 0;
+           batch_cnt++)
+        {
+          batch[batch_cnt] = readahead_queue[readahead_head];
+          readahead_head = (readahead_head + 1) % READAHEAD_QUEUE_SIZE;
+          readahead_cnt--;
+        }
+      lock_release (&readahead_lock);
+
+      block_cnt = 0;
+      for (i = 0; i < batch_cnt; i++)
+        {
+          struct cache_block *cache_block;
+          struct block_request *r;
+
+          cache_block = cache_acquire (batch[i].block, batch[i].sector,
+                                       true, false, ACQUIRE_READAHEAD);
+          if (cache_block == NULL)
+            continue;
+
+          r = &requests[block_cnt];
+          r->write = false;
+          r->sector = batch[i].sector;
+          r->cnt = 1;
+          r->buffer = cache_block->data;
+          r->buffers = NULL;
+          r->complete = NULL;
+          block_submit (batch[i].block, r);
+          blocks[block_cnt++] = cache_block;
+        }
+
+      for (i = 0; i < block_cnt; i++)
+        {
+          block_wait (&requests[i]);
+          cache_release (blocks[i], true, false, NULL);
+        }
+    }
+}
+
+/* qsort() comparison function for cache block pointers, by
+   device and then sector number. */
+static int
+compare_sectors (const void *a_, const void *b_)
+{
+  const struct cache_block *a = *(struct cache_block * const *) a_;
+  const struct cache_block *b = *(struct cache_block * const *) b_;
+  if (a->device != b->device)
+    return a->device < b->device ? -1 : 1;
+  return a->sector < b->sector ? -1 : a->sector > b->sector;
+}
+
+/* Sorts the CNT pinned blocks in VICTIMS by device and sector,
+   writes them back with consecutive sectors grouped into runs,
+   and unpins them.  Up to WRITE_WINDOW runs are queued at once,
+   so that the block layer can order and merge them.  cache_lock
+   must not be held. */
+static void
+cache_write_sorted (struct cache_block **victims, size_t cnt)
+{
+  struct cache_run fallback;
+  struct cache_run *window;
+  size_t window_cnt, started;
+  size_t i;
+
+  window = malloc (WRITE_WINDOW * sizeof *window);
+  window_cnt = WRITE_WINDOW;
+  if (window == NULL)
+    {
+      window = &fallback;
+      window_cnt = 1;
+    }
+
+  /* Read locks are taken in ascending order across runs too, as
+     for a single run. */
+  qsort (victims, cnt, sizeof *victims, compare_sectors);
+  started = 0;
+  for (i = 0; i < cnt; )
+    {
+      struct cache_run *run = &window[started % window_cnt];
+      size_t run_cnt = 1;
+      while (i + run_cnt < cnt
+             && run_cnt < (size_t) cache_cluster_max
+             && victims[i + run_cnt]->device == victims[i]->device
+             && victims[i + run_cnt]->sector == victims[i]->sector + run_cnt)
+        run_cnt++;
+      if (started >= window_cnt)
+        cache_run_finish (run);
+      cache_run_start (run, victims + i, run_cnt);
+      started++;
+      i += run_cnt;
+    }
+  for (i = started > window_cnt ? started - window_cnt : 0; i < started; i++)
+    cache_run_finish (&window[i % window_cnt]);
+  if (window != &fallback)
+    free (window);
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cnt; i++)
+    cache_unpin (victims[i]);
+  lock_release (&cache_lock);
+}
+
+/* Pins every block that is dirty at the time of the call and
+   stores it into VICTIMS, which must have room for cache_max_cnt
+   pointers.  Returns the number stored. */
+static size_t
+cache_collect_dirty (struct cache_block **victims)
+{
+  size_t victim_cnt = 0;
+  size_t i;
+
+  lock_acquire (&cache_lock);
+  for (i = 0; i < cache_cnt; i++)
+    {
+      struct cache_block *cache_block = &cache_blocks[i];
+      if (cache_block->valid && cache_block->dirty)
+        {
+          cache_block->pin_cnt++;
+          victims[victim_cnt++] = cache_block;
+        }
+    }
+  lock_release (&cache_lock);
+  return victim_cnt;
+}
+
+/* Writes back every block that is dirty at the time of the
+   call, in ascending sector order for each device, so that each
+   disk sweeps across the platter once. */
+static void
+cache_write_behind (void)
+{
+  static struct cache_block **victims;
+
+  /* Only the flusher thread calls us, so one array will do. */
+  if (victims == NULL)
+    {
+      victims = malloc (cache_max_cnt * sizeof *victims);
+      if (victims == NULL)
+        return;
+    }
+  cache_write_sorted (victims, cache_collect_dirty (victims));
+}
+
+/* Flusher thread.  Each time cache_request_flush() wakes it,
+   writes back all the dirty blocks, so that eviction rarely has
+   to wait for a write. */
+static void
+flusher_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      while (!flush_requested)
+        cond_wait (&flush_wanted, &cache_lock);
+      flush_requested = false;
+      lock_release (&cache_lock);
+
+      free_map_flush ();
+      cache_write_behind ();
+    }
+}
+
+/* Flush timer thread.  Wakes the flusher every
+   cache_flush_interval ticks, so that dirty blocks reach the
+   disk even if too few become dirty to wake it sooner. */
+static void
+flush_timer_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (cache_flush_interval);
+      lock_acquire (&cache_lock);
+      cache_request_flush ();
+      lock_release (&cache_lock);
+    }
+}
+
+/* Returns the last page of cache_arena to the kernel pool, if
+   none of its blocks is pinned or dirty.  Returns true if
+   successful.  cache_lock must be held. */
+static bool
+cache_shrink (void)
+{
+  struct cache_block *first;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  if (cache_cnt <= CACHE_MIN_PAGES * SECTORS_PER_PAGE)
+    return false;
+  first = &cache_blocks[cache_cnt - SECTORS_PER_PAGE];
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    if (first[i].pin_cnt > 0 || first[i].dirty)
+      return false;
+
+  for (i = 0; i < SECTORS_PER_PAGE; i++)
+    {
+      if (first[i].valid)
+        {
+          hash_delete (&cache_hash, &first[i].hash_elem);
+          first[i].device->cnt--;
+        }
+      cache_policy->remove (&first[i]);
+    }
+  cache_cnt -= SECTORS_PER_PAGE;
+  reclaim_cnt++;
+  palloc_free_page (first->data);
+  return true;
+}
+
+/* Called by the page allocator when it runs out of kernel
+   pages.  Shrinks the cache by up to PAGE_CNT pages, without
+   doing any I/O, and returns true if it freed any. */
+static bool
+cache_reclaim (size_t page_cnt)
+{
+  size_t freed = 0;
+
+  /* A thread in the middle of a cache operation could deadlock
+     against itself. */
+  if (lock_held_by_current_thread (&cache_lock))
+    return false;
+
+  lock_acquire (&cache_lock);
+  while (freed < page_cnt && cache_shrink ())
+    freed++;
+  lock_release (&cache_lock);
+  return freed > 0;
+}
+
+/* Fills in the members of STATS that fit in STATS->size bytes,
+   then sets STATS->version and STATS->size to match. */
+void
+cache_get_stats (struct cache_stats *stats)
+{
+  struct cache_stats s;
+
+  s.version = CACHE_STATS_VERSION;
+  s.size = stats->size < sizeof s ? stats->size : sizeof s;
+
+  lock_acquire (&cache_lock);
+  s.sectors = cache_cnt;
+  s.max_sectors = cache_max_cnt;
+  s.hits = hit_cnt;
+  s.misses = miss_cnt;
+  s.evictions = evict_cnt;
+  s.dirty_evictions = evict_dirty_cnt;
+  s.eviction_cycles = evict_cycles;
+  s.write_backs = write_back_cnt;
+  s.read_modify_writes = rmw_cnt;
+  s.readahead_issued = readahead_issue_cnt;
+  s.readahead_used = readahead_hit_cnt;
+  s.readahead_wasted = readahead_waste_cnt;
+  s.reclaimed_pages = reclaim_cnt;
+  lock_release (&cache_lock);
+  s.device_reads = get_block_reads (BLOCK_FILESYS);
+  s.device_writes = get_block_writes (BLOCK_FILESYS);
+
+  memcpy (stats, &s, s.size);
 }
 
+/* Prints cache statistics. */
 void
-cache_flush ()
+cache_print_stats (void)
 {
-  while (list_size (&cache_list))
+  struct cache_stats s;
+  struct cache_device *d;
+  uint64_t lookups;
+
+  s.size = sizeof s;
+  cache_get_stats (&s);
+  lookups = s.hits + s.misses;
+  printf ("Cache: %"PRIu32" of %"PRIu32" sectors, %"PRIu64" pages reclaimed, "
+          "%s policy\n",
+          s.sectors, s.max_sectors, s.reclaimed_pages, cache_policy->name);
+  printf ("Cache: %"PRIu64" hits, %"PRIu64" misses, %"PRIu64"%% hit rate, "
+          "%"PRIu64" read-modify-writes\n",
+          s.hits, s.misses, lookups > 0 ? s.hits * 100 / lookups : 0,
+          s.read_modify_writes);
+  printf ("Cache: %"PRIu64" evictions, %"PRIu64" of dirty blocks, "
+          "%"PRIu64" cycles per eviction, %"PRIu64" write-backs\n",
+          s.evictions, s.dirty_evictions,
+          s.evictions > 0 ? s.eviction_cycles / s.evictions : 0,
+          s.write_backs);
+  printf ("Cache: %"PRIu64" sectors read ahead, %"PRIu64" used, "
+          "%"PRIu64" wasted\n",
+          s.readahead_issued, s.readahead_used, s.readahead_wasted);
+
+  lock_acquire (&cache_lock);
+  for (d = cache_devices; d < cache_devices + cache_device_cnt; d++)
+    printf ("Cache: %s holds %zu sectors, quota %d%%\n",
+            block_name (d->block), d->cnt, d->quota_pct);
+  lock_release (&cache_lock);
+}
+
+/* Writes back every block that is dirty at the time of the
+   call, sorted and clustered as the flusher does, and waits for
+   them to reach the disk. */
+void
+cache_flush (void)
+{
+  struct cache_block **victims = malloc (cache_max_cnt * sizeof *victims);
+  if (victims != NULL)
     {
-      struct list_elem *e = list_pop_front (&cache_list);
-      struct cache_block *cache_block = list_entry (e, struct cache_block, list_elem);
-      cache_out (cache_block);
+      cache_write_sorted (victims, cache_collect_dirty (victims));
+      free (victims);
+      return;
+    }
+
+  /* Out of memory: write back one block at a time. */
+  lock_acquire (&cache_lock);
+  for (size_t i = 0; i < cache_cnt; i++)
+    {
+      struct cache_block *cache_block = &cache_blocks[i];
+      if (!cache_block->valid || !cache_block->dirty)
+        continue;
+
+      cache_block->pin_cnt++;
+      lock_release (&cache_lock);
+      cache_write_run (&cache_block, 1);
+      lock_acquire (&cache_lock);
+      cache_unpin (cache_block);
     }
+  lock_release (&cache_lock);
+}
+
+/* Initializes OWNER, with no dirty blocks. */
+void
+cache_owner_init (struct cache_owner *owner)
+{
+  list_init (&owner->dirty);
+}
+
+/* Takes every block off OWNER's dirty list, leaving them dirty,
+   so that OWNER may be freed. */
+void
+cache_owner_release (struct cache_owner *owner)
+{
+  lock_acquire (&cache_lock);
+  while (!list_empty (&owner->dirty))
+    {
+      struct list_elem *e = list_pop_front (&owner->dirty);
+      list_entry (e, struct cache_block, owner_elem)->owner = NULL;
+    }
+  lock_release (&cache_lock);
+}
+
+/* Writes back the blocks on OWNER's dirty list, in ascending
+   sector order, and waits for them to reach the disk. */
+void
+cache_sync (struct cache_owner *owner)
+{
+  struct cache_block **victims;
+  struct list_elem *e;
+  size_t max_cnt, cnt = 0;
+
+  /* Size the array without cache_lock, since malloc() may call
+     back into cache_reclaim().  Blocks dirtied in between are
+     left for the next sync. */
+  lock_acquire (&cache_lock);
+  max_cnt = list_size (&owner->dirty);
+  lock_release (&cache_lock);
+  if (max_cnt == 0)
+    return;
+  victims = malloc (max_cnt * sizeof *victims);
+  if (victims == NULL)
+    {
+      /* Fall back to writing back the whole cache. */
+      cache_flush ();
+      return;
+    }
+
+  lock_acquire (&cache_lock);
+  for (e = list_begin (&owner->dirty);
+       e != list_end (&owner->dirty) && cnt < max_cnt;
+       e = list_next (e))
+    {
+      struct cache_block *cache_block
+        = list_entry (e, struct cache_block, owner_elem);
+      cache_block->pin_cnt++;
+      victims[cnt++] = cache_block;
+    }
+  lock_release (&cache_lock);
+
+  cache_write_sorted (victims, cnt);
+  free (victims);
+}
+
+/* Writes back SECTOR of BLOCK if it is cached and dirty. */
+void
+cache_sync_sector (struct block *block, block_sector_t sector)
+{
+  struct cache_block *cache_block;
+
+  lock_acquire (&cache_lock);
+  cache_block = cache_lookup (cache_device (block), sector);
+  if (cache_block != NULL && cache_block->dirty)
+    {
+      cache_block->pin_cnt++;
+      lock_release (&cache_lock);
+      cache_write_run (&cache_block, 1);
+      lock_acquire (&cache_lock);
+      cache_unpin (cache_block);
+    }
+  lock_release (&cache_lock);
 }
 
 #else
 
+/* Without the cache, cache_get() hands out a malloc()'d copy of
+   the sector, which cache_put() writes back if needed. */
+struct uncached_sector
+  {
+    struct block *block;
+    block_sector_t sector;
+    enum cache_mode mode;
+    uint8_t data[BLOCK_SECTOR_SIZE];
+  };
+
 void
 cache_init (void)
 {
   return;
 }
 
+void *
+cache_get (struct block *block, block_sector_t sector, enum cache_mode mode)
+{
+  struct uncached_sector *u = malloc (sizeof *u);
+  if (u == NULL)
+    PANIC ("out of memory for uncached sector");
+  u->block = block;
+  u->sector = sector;
+  u->mode = mode;
+  if (mode != CACHE_OVERWRITE)
+    block_read (block, sector, u->data);
+  return u->data;
+}
+
+void
+cache_put (void *data)
+{
+  struct uncached_sector *u
+    = (struct uncached_sector *) ((uint8_t *) data
+                                  - offsetof (struct uncached_sector, data));
+  if (u->mode != CACHE_READ)
+    block_write (u->block, u->sector, u->data);
+  free (u);
+}
+
+void
+cache_put_owned (void *data, struct cache_owner *owner UNUSED)
+{
+  cache_put (data);
+}
+
 void
 cache_read (struct block *block, block_sector_t sector, void *buffer)
 {
@@ -165,8 +1673,94 @@ cache_write (struct block *block, block_sector_t sector, const void *buffer)
   block_write (block, sector, buffer);
 }
 
+/* Block requests run in the device's I/O thread, which cannot
+   see user memory, so a user BUFFER is filled a sector at a time
+   through cache_get()'s copies. */
+void
+cache_read_multiple (struct block *block, block_sector_t sector,
+                     void *buffer_, size_t cnt)
+{
+  uint8_t *buffer = buffer_;
+  size_t i;
+
+  if (!is_user_vaddr (buffer))
+    {
+      block_read_multiple (block, sector, buffer, cnt);
+      return;
+    }
+
+  for (i = 0; i < cnt; i++)
+    {
+      void *data = cache_get (block, sector + i, CACHE_READ);
+      memcpy (buffer + i * BLOCK_SECTOR_SIZE, data, BLOCK_SECTOR_SIZE);
+      cache_put (data);
+    }
+}
+
+void
+cache_write_multiple (struct block *block, block_sector_t sector,
+                      const void *buffer, size_t cnt)
+{
+  block_write_multiple (block, sector, buffer, cnt);
+}
+
+void
+cache_readahead (struct block *block UNUSED, block_sector_t sector UNUSED)
+{
+  return;
+}
+
+bool
+cache_set_policy (const char *name UNUSED)
+{
+  return true;
+}
+
+void
+cache_get_stats (struct cache_stats *stats)
+{
+  struct cache_stats s;
+
+  memset (&s, 0, sizeof s);
+  s.version = CACHE_STATS_VERSION;
+  s.size = stats->size < sizeof s ? stats->size : sizeof s;
+  s.device_reads = get_block_reads (BLOCK_FILESYS);
+  s.device_writes = get_block_writes (BLOCK_FILESYS);
+  memcpy (stats, &s, s.size);
+}
+
+void
+cache_print_stats (void)
+{
+  return;
+}
+
+void
+cache_flush (void)
+{
+  return;
+}
+
+void
+cache_owner_init (struct cache_owner *owner)
+{
+  list_init (&owner->dirty);
+}
+
+void
+cache_owner_release (struct cache_owner *owner UNUSED)
+{
+  return;
+}
+
+void
+cache_sync (struct cache_owner *owner UNUSED)
+{
+  return;
+}
+
 void
-cache_flush ()
+cache_sync_sector (struct block *block UNUSED, block_sector_t sector UNUSED)
 {
   return;
 }
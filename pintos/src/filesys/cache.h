@@ -1,17 +1,76 @@
 #ifndef FILESYS_CACHE_H
 #define FILESYS_CACHE_H
 
+#include <list.h>
 #include <stdbool.h>
 #include "devices/block.h"
 
+struct cache_stats;
+
 /* You can disable cache by commenting this. */
 #define ENABLE_CACHE
 
-#define CACHE_SIZE 64
+/* Default cache size, in sectors. */
+#define CACHE_DEFAULT_SIZE 64
+
+/* Most of the cache that a device other than the file system
+   device may hold, as a percentage. */
+#define CACHE_DEVICE_QUOTA_PCT 25
+
+/* Default maximum read-ahead window, in sectors. */
+#define READAHEAD_MAX 16
+
+/* Default timer ticks between write-behind passes. */
+#define FLUSH_INTERVAL 50
+
+/* The flusher also wakes up early when more than this
+   percentage of the cache is dirty. */
+#define FLUSH_DIRTY_PCT 50
+
+/* Default and greatest number of dirty sectors written back
+   together as one request. */
+#define CLUSTER_MAX 16
+#define CLUSTER_LIMIT 64
+
+/* How cache_get() will use a sector. */
+enum cache_mode
+  {
+    CACHE_READ,                 /* Read only, shared with other readers. */
+    CACHE_WRITE,                /* Read and modify. */
+    CACHE_OVERWRITE             /* Overwrite entirely, old data unread. */
+  };
+
+/* Something, such as an inode, that wants to write back its
+   own dirty sectors with cache_sync().  Sectors released with
+   cache_put_owned() stay on its dirty list until written back. */
+struct cache_owner
+  {
+    struct list dirty;          /* Dirty cache blocks. */
+  };
+
+extern int cache_readahead_max;
+extern int cache_flush_interval;
+extern int cache_cluster_max;
+extern int cache_size;
+extern int cache_pct;
 
+bool cache_set_policy (const char *);
 void cache_init (void);
 void cache_read (struct block *, block_sector_t, void *);
 void cache_write (struct block *, block_sector_t, const void *);
-void cache_flush ();
+void cache_read_multiple (struct block *, block_sector_t, void *, size_t cnt);
+void cache_write_multiple (struct block *, block_sector_t, const void *,
+                           size_t cnt);
+void *cache_get (struct block *, block_sector_t, enum cache_mode);
+void cache_put (void *);
+void cache_put_owned (void *, struct cache_owner *);
+void cache_readahead (struct block *, block_sector_t);
+void cache_flush (void);
+void cache_owner_init (struct cache_owner *);
+void cache_owner_release (struct cache_owner *);
+void cache_sync (struct cache_owner *);
+void cache_sync_sector (struct block *, block_sector_t);
+void cache_get_stats (struct cache_stats *);
+void cache_print_stats (void);
 
 #endif /* filesys/cache.h */
\ No newline at end of file
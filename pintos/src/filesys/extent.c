@@ -0,0 +1,360 @@
+#include "filesys/extent.h"
+#include <debug.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/malloc.h"
+
+/* Identifies an extent tree node. */
+#define EXTENT_MAGIC 0x4558544e
+
+/* A node below the root, one sector long. */
+#define EXTENT_NODE_CNT 42
+struct extent_node
+  {
+    unsigned magic;                     /* EXTENT_MAGIC. */
+    struct extent_header h;
+    struct extent e[EXTENT_NODE_CNT];
+  };
+
+/* Initializes ROOT as an empty extent map. */
+void
+extent_init (struct extent_root *root)
+{
+  ASSERT (sizeof (struct extent_node) == BLOCK_SECTOR_SIZE);
+
+  memset (root, 0, sizeof *root);
+}
+
+/* Returns the number of entries among the CNT in E whose LOGICAL
+   is at most LOGICAL, which is one more than the index of the
+   entry that covers LOGICAL, if any. */
+static size_t
+search (const struct extent *e, size_t cnt, uint32_t logical)
+{
+  size_t lo = 0, hi = cnt;
+
+  while (lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (e[mid].logical <= logical)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+  return lo;
+}
+
+/* Returns the disk sector that holds file sector LOGICAL in the
+   map rooted at ROOT, or -1 if LOGICAL is not mapped.  If RUN is
+   non-null, stores in *RUN how many file sectors starting at
+   LOGICAL are mapped to consecutive disk sectors, or, if LOGICAL
+   is not mapped, how many in a row are unmapped, so that a whole
+   run needs only one lookup. */
+block_sector_t
+extent_lookup (const struct extent_root *root, uint32_t logical,
+               size_t *run)
+{
+  const struct extent_header *h = &root->h;
+  const struct extent *e = root->e;
+  struct extent_node *node = NULL;
+  uint32_t limit = UINT32_MAX;  /* First file sector past this subtree. */
+  block_sector_t sector = -1;
+  size_t cnt;
+
+  for (;;)
+    {
+      size_t n = search (e, h->cnt, logical);
+
+      if (h->depth == 0)
+        {
+          if (n > 0 && logical - e[n - 1].logical < e[n - 1].cnt)
+            {
+              uint32_t ofs = logical - e[n - 1].logical;
+              sector = e[n - 1].start + ofs;
+              cnt = e[n - 1].cnt - ofs;
+            }
+          else
+            cnt = (n < h->cnt ? e[n].logical : limit) - logical;
+          break;
+        }
+      else if (h->cnt == 0)
+        {
+          cnt = limit - logical;
+          break;
+        }
+      else
+        {
+          block_sector_t child;
+
+          if (n < h->cnt)
+            limit = e[n].logical;
+          child = e[n > 0 ? n - 1 : 0].start;
+          if (node != NULL)
+            cache_put (node);
+          node = cache_get (fs_device, child, CACHE_READ);
+          ASSERT (node->magic == EXTENT_MAGIC);
+          h = &node->h;
+          e = node->e;
+        }
+    }
+  if (node != NULL)
+    cache_put (node);
+
+  if (run != NULL)
+    *run = cnt;
+  return sector;
+}
+
+/* Returns a copy of the node in SECTOR, which the caller must
+   free, or a null pointer if memory is short.  The cache allows
+   a thread only one sector at a time, so a walk down the tree
+   that modifies nodes works on copies. */
+static struct extent_node *
+node_read (block_sector_t sector)
+{
+  struct extent_node *node = malloc (sizeof *node);
+  if (node != NULL)
+    {
+      cache_read (fs_device, sector, node);
+      ASSERT (node->magic == EXTENT_MAGIC);
+    }
+  return node;
+}
+
+/* Writes NODE to SECTOR through the cache, on OWNER's behalf. */
+static void
+node_write (block_sector_t sector, const struct extent_node *node,
+            struct cache_owner *owner)
+{
+  void *data = cache_get (fs_device, sector, CACHE_OVERWRITE);
+  memcpy (data, node, BLOCK_SECTOR_SIZE);
+  cache_put_owned (data, owner);
+}
+
+/* Inserts X at index I among the entries E of the node with
+   header H, which must have room for it. */
+static void
+put (struct extent_header *h, struct extent *e, size_t i,
+     const struct extent *x)
+{
+  memmove (e + i + 1, e + i, (h->cnt - i) * sizeof *e);
+  e[i] = *x;
+  h->cnt++;
+}
+
+/* CHILD, a copy of the node that entry I of the node with header
+   H and entries E points to, is full.  Splits it in two, moving
+   its upper entries to a new node and adding an index entry for
+   that node after entry I, for which there must be room.  When
+   an insertion at LOGICAL is appending, as a growing file does,
+   moves only the last entry, so that nodes stay nearly full.
+   Both nodes are written before returning.  Returns false if no
+   sector was available for the new node, without changing
+   anything. */
+static bool
+split (struct extent_header *h, struct extent *e, size_t i,
+       struct extent_node *child, uint32_t logical,
+       struct cache_owner *owner)
+{
+  struct extent_node *sibling;
+  struct extent index;
+  block_sector_t sector;
+  size_t keep;
+
+  if (free_map_allocate_near (e[i].start, 1, &sector) == 0)
+    return false;
+  keep = (search (child->e, child->h.cnt, logical) == child->h.cnt
+          ? child->h.cnt - 1 : child->h.cnt / 2);
+
+  sibling = cache_get (fs_device, sector, CACHE_OVERWRITE);
+  memset (sibling, 0, sizeof *sibling);
+  sibling->magic = EXTENT_MAGIC;
+  sibling->h.depth = child->h.depth;
+  sibling->h.cnt = child->h.cnt - keep;
+  memcpy (sibling->e, child->e + keep, sibling->h.cnt * sizeof *child->e);
+  index.logical = sibling->e[0].logical;
+  index.start = sector;
+  index.cnt = 0;
+  cache_put_owned (sibling, owner);
+
+  child->h.cnt = keep;
+  node_write (e[i].start, child, owner);
+  put (h, e, i + 1, &index);
+  return true;
+}
+
+/* Inserts extent X into the subtree whose top node has header H
+   and entries E, which must have room for one more entry.  Full
+   nodes on the way down are split before descending into them,
+   so that a split never has to propagate back up.  Every node
+   below the top is written as it changes, and the tree stays
+   consistent even if this fails partway; the caller must still
+   write the top node.  Returns false if memory or a sector for a
+   new node ran out. */
+static bool
+insert (struct extent_header *h, struct extent *e, const struct extent *x,
+        struct cache_owner *owner)
+{
+  size_t n = search (e, h->cnt, x->logical);
+
+  if (h->depth == 0)
+    {
+      /* Grow the preceding extent if X continues it. */
+      if (n > 0)
+        {
+          struct extent *prev = &e[n - 1];
+          if (prev->logical + prev->cnt == x->logical
+              && prev->start + prev->cnt == x->start)
+            {
+              prev->cnt += x->cnt;
+              return true;
+            }
+        }
+      put (h, e, n, x);
+      return true;
+    }
+  else
+    {
+      size_t i = n > 0 ? n - 1 : 0;
+      struct extent_node *child;
+      bool success;
+
+      if (x->logical < e[i].logical)
+        e[i].logical = x->logical;
+      child = node_read (e[i].start);
+      if (child == NULL)
+        return false;
+      if (child->h.cnt == EXTENT_NODE_CNT)
+        {
+          if (!split (h, e, i, child, x->logical, owner))
+            {
+              free (child);
+              return false;
+            }
+          if (x->logical >= e[i + 1].logical)
+            {
+              free (child);
+              child = node_read (e[++i].start);
+              if (child == NULL)
+                return false;
+            }
+        }
+      success = insert (&child->h, child->e, x, owner);
+      node_write (e[i].start, child, owner);
+      free (child);
+      return success;
+    }
+}
+
+/* Moves ROOT's entries into a new node and makes ROOT an index
+   with that node as its only child, so that ROOT has room for
+   another entry.  Returns false if no node could be
+   allocated. */
+static bool
+grow (struct extent_root *root, struct cache_owner *owner)
+{
+  struct extent_node *node;
+  block_sector_t sector;
+
+  if (!free_map_allocate (1, &sector))
+    return false;
+  node = cache_get (fs_device, sector, CACHE_OVERWRITE);
+  memset (node, 0, sizeof *node);
+  node->magic = EXTENT_MAGIC;
+  node->h = root->h;
+  memcpy (node->e, root->e, root->h.cnt * sizeof *root->e);
+  cache_put_owned (node, owner);
+
+  root->e[0].start = sector;
+  root->e[0].cnt = 0;
+  root->h.cnt = 1;
+  root->h.depth++;
+  return true;
+}
+
+/* Maps the CNT file sectors starting at LOGICAL, which must not
+   be mapped already, to the disk sectors starting at START, in
+   the map rooted at ROOT.  Nodes that change are written through
+   the cache on OWNER's behalf; writing ROOT, which may change
+   even on failure, is up to the caller.  Returns true if
+   successful, false if memory or disk space for a new node ran
+   out. */
+bool
+extent_insert (struct extent_root *root, struct cache_owner *owner,
+               uint32_t logical, block_sector_t start, uint32_t cnt)
+{
+  struct extent x;
+
+  ASSERT (cnt > 0);
+
+  if (root->h.cnt == EXTENT_ROOT_CNT && !grow (root, owner))
+    return false;
+
+  x.logical = logical;
+  x.start = start;
+  x.cnt = cnt;
+  return insert (&root->h, root->e, &x, owner);
+}
+
+/* Releases the disk sectors that hold file sectors LOGICAL and
+   up in the subtree whose top node has header H and entries E,
+   and removes them from the subtree, releasing nodes that become
+   empty. */
+static void
+release (struct extent_header *h, struct extent *e, uint32_t logical,
+         struct cache_owner *owner)
+{
+  while (h->cnt > 0)
+    {
+      struct extent *x = &e[h->cnt - 1];
+
+      if (h->depth == 0)
+        {
+          if (x->logical >= logical)
+            {
+              free_map_release (x->start, x->cnt);
+              h->cnt--;
+              continue;
+            }
+          if (x->logical + x->cnt > logical)
+            {
+              uint32_t keep = logical - x->logical;
+              free_map_release (x->start + keep, x->cnt - keep);
+              x->cnt = keep;
+            }
+          break;
+        }
+      else
+        {
+          struct extent_node *child = node_read (x->start);
+          bool empty;
+
+          if (child == NULL)
+            PANIC ("out of memory releasing extents");
+          release (&child->h, child->e, logical, owner);
+          empty = child->h.cnt == 0;
+          if (!empty)
+            node_write (x->start, child, owner);
+          free (child);
+          if (!empty)
+            break;
+          free_map_release (x->start, 1);
+          h->cnt--;
+        }
+    }
+}
+
+/* Releases the disk sectors that hold file sectors LOGICAL and
+   up in the map rooted at ROOT, and removes them from the map,
+   along with any nodes that become empty.  With LOGICAL of 0,
+   frees everything but ROOT itself. */
+void
+extent_release (struct extent_root *root, struct cache_owner *owner,
+                uint32_t logical)
+{
+  release (&root->h, root->e, logical, owner);
+  if (root->h.cnt == 0)
+    root->h.depth = 0;
+}
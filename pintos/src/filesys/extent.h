@@ -0,0 +1,55 @@
+#ifndef FILESYS_EXTENT_H
+#define FILESYS_EXTENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+
+struct cache_owner;
+
+/* Extent maps.
+
+   An extent map says where on disk each sector of a file lives,
+   as a B-tree of extents, runs of consecutive file sectors that
+   are also consecutive on disk.  The root of the tree is kept in
+   the inode; further nodes each take one sector.  Leaves hold
+   extents, and interior nodes hold index entries that point to
+   the nodes below them.  Entries in a node are in order of
+   LOGICAL, and an index entry's LOGICAL is no greater than that
+   of any extent below it. */
+
+/* An extent, or an index entry. */
+struct extent
+  {
+    uint32_t logical;           /* First file sector covered. */
+    block_sector_t start;       /* Extent: first disk sector.
+                                   Index entry: sector of child node. */
+    uint32_t cnt;               /* Extent: number of sectors.
+                                   Index entry: unused. */
+  };
+
+/* Start of each node. */
+struct extent_header
+  {
+    uint16_t cnt;               /* Entries in use. */
+    uint16_t depth;             /* 0 for a leaf, else levels below. */
+  };
+
+/* Root of an extent map, as stored in an inode. */
+#define EXTENT_ROOT_CNT 41
+struct extent_root
+  {
+    struct extent_header h;
+    struct extent e[EXTENT_ROOT_CNT];
+  };
+
+void extent_init (struct extent_root *);
+block_sector_t extent_lookup (const struct extent_root *, uint32_t logical,
+                              size_t *run);
+bool extent_insert (struct extent_root *, struct cache_owner *,
+                    uint32_t logical, block_sector_t start, uint32_t cnt);
+void extent_release (struct extent_root *, struct cache_owner *,
+                     uint32_t logical);
+
+#endif /* filesys/extent.h */
@@ -1,5 +1,7 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <round.h>
+#include "filesys/cache.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -9,8 +11,15 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+
+    /* Sequential read detection. */
+    off_t ra_next;              /* Offset a sequential read starts at. */
+    off_t ra_limit;             /* Read-ahead already queued up to here. */
+    int ra_window;              /* Read-ahead window, in sectors. */
   };
 
+static void file_readahead (struct file *, off_t pos);
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
@@ -23,6 +32,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_limit = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -68,11 +80,47 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size)
 {
+  off_t start = file->pos;
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_read;
+  file_readahead (file, start);
   return bytes_read;
 }
 
+/* Updates FILE's read-ahead state after a file_read() that
+   started at offset POS and ended at FILE's current position.
+   A read that starts where the previous one ended doubles the
+   read-ahead window, up to cache_readahead_max sectors; any
+   other read halves it.  Then queues the sectors in the window
+   past the current position that have not been queued yet. */
+static void
+file_readahead (struct file *file, off_t pos)
+{
+  off_t start, end;
+
+  if (pos == file->ra_next)
+    file->ra_window = file->ra_window == 0 ? 4 : file->ra_window * 2;
+  else
+    {
+      file->ra_window /= 2;
+      file->ra_limit = 0;
+    }
+  if (file->ra_window > cache_readahead_max)
+    file->ra_window = cache_readahead_max;
+  file->ra_next = file->pos;
+
+  start = ROUND_UP (file->pos, BLOCK_SECTOR_SIZE);
+  if (start < file->ra_limit)
+    start = file->ra_limit;
+  end = ROUND_UP (file->pos, BLOCK_SECTOR_SIZE)
+        + file->ra_window * BLOCK_SECTOR_SIZE;
+  if (start < end)
+    {
+      inode_readahead (file->inode, start, end - start);
+      file->ra_limit = end;
+    }
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually read,
@@ -140,6 +188,14 @@ file_allow_write (struct file *file)
     }
 }
 
+/* Writes FILE's modified data and metadata back to disk. */
+void
+file_sync (struct file *file)
+{
+  ASSERT (file != NULL);
+  inode_sync (file->inode);
+}
+
 /* Returns the size of FILE in bytes. */
 off_t
 file_length (struct file *file)
@@ -158,6 +158,14 @@ filesys_init (bool format)
 
   if (format)
     do_format ();
+  else
+    {
+      /* Go on creating inodes in the format that the file system
+         was formatted with, which is that of the free map's. */
+      struct inode *inode = inode_open (FREE_MAP_SECTOR);
+      inode_use_extents = inode_has_extents (inode);
+      inode_close (inode);
+    }
 
   free_map_open ();
 }
@@ -171,6 +179,14 @@ filesys_done (void)
   cache_flush ();
 }
 
+/* Writes all modified file system data back to disk. */
+void
+filesys_sync (void)
+{
+  free_map_flush ();
+  cache_flush ();
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -183,7 +199,8 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
   // struct dir *dir = dir_open_root ();
   struct dir *dir = get_path (name, false, file_name);
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_near (get_dir_sector (dir), 1,
+                                             &inode_sector) == 1
                   && inode_create (inode_sector, initial_size, is_dir)
                   && dir_add (dir, file_name, inode_sector));
   if (!success && inode_sector != 0)
@@ -290,7 +307,8 @@ filesys_readdir (struct file *file, char name[NAME_MAX + 1])
 static void
 do_format (void)
 {
-  printf ("Formatting file system...");
+  printf ("Formatting file system%s...",
+          inode_use_extents ? " with extents" : "");
   free_map_create ();
   if (!dir_create (ROOT_DIR_SECTOR, 16))
     PANIC ("root directory creation failed");
@@ -1,52 +1,180 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "threads/synch.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
 
+/* Sectors of the free map file whose bits have changed since
+   they were last written, one bit per sector.  Allocation and
+   release only mark them; free_map_flush() writes them in a
+   batch, so that extending a file by N sectors does not rewrite
+   the whole free map N times. */
+static struct bitmap *dirty_sectors;
+
+/* Protects free_map and dirty_sectors. */
+static struct lock free_map_lock;
+
+/* Free map bits per sector of the free map file. */
+#define BITS_PER_SECTOR (BLOCK_SECTOR_SIZE * 8)
+
 /* Initializes the free map. */
 void
 free_map_init (void)
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
+  if (free_map == NULL || !bitmap_enable_summary (free_map))
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  dirty_sectors = bitmap_create (DIV_ROUND_UP (bitmap_file_size (free_map),
+                                               BLOCK_SECTOR_SIZE));
+  if (dirty_sectors == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+}
+
+/* Sets the CNT bits starting at START in the free map to VALUE,
+   and marks the free map file sectors that hold them dirty.
+   free_map_lock must be held. */
+static void
+set_bits (size_t start, size_t cnt, bool value)
+{
+  size_t first = start / BITS_PER_SECTOR;
+  size_t last = (start + cnt - 1) / BITS_PER_SECTOR;
+
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+  ASSERT (cnt > 0);
+
+  bitmap_set_multiple (free_map, start, cnt, value);
+  bitmap_set_multiple (dirty_sectors, first, last - first + 1, true);
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+   sectors were available. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector;
+
+  lock_acquire (&free_map_lock);
+  sector = bitmap_scan (free_map, 0, cnt, false);
+  if (sector != BITMAP_ERROR)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false);
-      sector = BITMAP_ERROR;
+      set_bits (sector, cnt, true);
+      *sectorp = sector;
     }
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
+/* Looks for free runs that start within sectors [START, END) of
+   the free map, remembering in *BEST_START and *BEST_CNT the
+   first that is longest, counting at most CNT sectors of each.
+   Returns true as soon as a run of CNT sectors turns up.
+   free_map_lock must be held. */
+static bool
+find_run (size_t start, size_t end, size_t cnt,
+          size_t *best_start, size_t *best_cnt)
+{
+  while (start < end)
+    {
+      size_t run_start = bitmap_scan (free_map, start, 1, false);
+      size_t run_end;
+
+      if (run_start == BITMAP_ERROR || run_start >= end)
+        break;
+      run_end = bitmap_scan (free_map, run_start, 1, true);
+      if (run_end == BITMAP_ERROR)
+        run_end = bitmap_size (free_map);
+      if (run_end - run_start > *best_cnt)
+        {
+          *best_start = run_start;
+          *best_cnt = run_end - run_start < cnt ? run_end - run_start : cnt;
+          if (*best_cnt == cnt)
+            return true;
+        }
+      start = run_end;
+    }
+  return false;
+}
+
+/* Allocates up to CNT consecutive sectors from the free map, as
+   near as possible after sector GOAL: the first run of CNT free
+   sectors at or after GOAL, or if there is none, the longest
+   free run on the device, looking onward from GOAL and then
+   wrapping around.  Stores the first sector allocated into
+   *SECTORP and returns the number allocated, which is 0 if no
+   sector is free. */
+size_t
+free_map_allocate_near (block_sector_t goal, size_t cnt,
+                        block_sector_t *sectorp)
+{
+  size_t size = bitmap_size (free_map);
+  size_t best_start = 0, best_cnt = 0;
+
+  ASSERT (cnt > 0);
+
+  if (goal >= size)
+    goal = 0;
+  lock_acquire (&free_map_lock);
+  if (!find_run (goal, size, cnt, &best_start, &best_cnt))
+    find_run (0, goal, cnt, &best_start, &best_cnt);
+  if (best_cnt > 0)
+    {
+      set_bits (best_start, best_cnt, true);
+      *sectorp = best_start;
+    }
+  lock_release (&free_map_lock);
+  return best_cnt;
+}
+
 /* Makes CNT sectors starting at SECTOR available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  lock_acquire (&free_map_lock);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  set_bits (sector, cnt, false);
+  lock_release (&free_map_lock);
+}
+
+/* Writes the free map file sectors marked dirty since the last
+   call back to the free map file, each run of adjacent ones with
+   a single write.  Called at batch points: the end of each file
+   extension, each pass of the cache flusher, fsync, and
+   shutdown. */
+void
+free_map_flush (void)
+{
+  size_t start = 0;
+
+  if (dirty_sectors == NULL)
+    return;
+
+  lock_acquire (&free_map_lock);
+  while (free_map_file != NULL
+         && (start = bitmap_scan (dirty_sectors, start, 1, true))
+         != BITMAP_ERROR)
+    {
+      size_t end = bitmap_scan (dirty_sectors, start, 1, false);
+      if (end == BITMAP_ERROR)
+        end = bitmap_size (dirty_sectors);
+      if (!bitmap_write_part (free_map, free_map_file,
+                              start * BLOCK_SECTOR_SIZE,
+                              (end - start) * BLOCK_SECTOR_SIZE))
+        PANIC ("can't write free map");
+      bitmap_set_multiple (dirty_sectors, start, end - start, false);
+      start = end;
+    }
+  lock_release (&free_map_lock);
 }
 
 /* Opens the free map file and reads it from disk. */
@@ -58,13 +186,29 @@ free_map_open (void)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+  bitmap_set_all (dirty_sectors, false);
 }
 
 /* Writes the free map to disk and closes the free map file. */
 void
 free_map_close (void)
 {
-  file_close (free_map_file);
+  struct file *file;
+
+  free_map_flush ();
+  lock_acquire (&free_map_lock);
+  file = free_map_file;
+  free_map_file = NULL;
+  lock_release (&free_map_lock);
+  file_close (file);
+}
+
+/* Writes the free map file's modified sectors back to disk. */
+void
+free_map_sync (void)
+{
+  free_map_flush ();
+  file_sync (free_map_file);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -72,14 +216,27 @@ free_map_close (void)
 void
 free_map_create (void)
 {
+  struct file *file;
+
   /* Create inode. */
   if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap to file.  The new file is a hole, so this
+     allocates its sectors, which must all be in place before
+     free_map_flush() may write to it: filling a hole takes
+     free_map_lock, which free_map_flush() holds while it
+     writes. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file))
     PANIC ("can't write free map");
+
+  /* Now write the bits for the sectors allocated along the
+     way. */
+  lock_acquire (&free_map_lock);
+  free_map_file = file;
+  lock_release (&free_map_lock);
+  free_map_flush ();
 }
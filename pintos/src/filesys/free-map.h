@@ -10,8 +10,12 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_sync (void);
+void free_map_flush (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+size_t free_map_allocate_near (block_sector_t goal, size_t,
+                               block_sector_t *);
 void free_map_release (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
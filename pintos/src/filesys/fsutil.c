@@ -1,31 +1,72 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "devices/block-trace.h"
+#include "filesys/cache.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
-/* List files in the root directory. */
+/* Sectors moved to or from the scratch device per request. */
+#define FSUTIL_RUN_SECTORS 64
+
+/* Where the next `append' writes on the scratch device. */
+static block_sector_t append_sector;
+
+/* Prints the average of SECTORS sectors over EXTENTS extents,
+   to two decimal places. */
+static void
+print_average (size_t sectors, size_t extents)
+{
+  size_t hundredths = extents > 0 ? sectors * 100 / extents : 0;
+  printf ("%4zu.%02zu", hundredths / 100, hundredths % 100);
+}
+
+/* List files in the root directory, with how fragmented each
+   one is: the number of runs of consecutive sectors ("extents")
+   that its data is in, and their average length. */
 void
 fsutil_ls (char **argv UNUSED)
 {
   struct dir *dir;
   char name[NAME_MAX + 1];
+  size_t total_sectors = 0, total_extents = 0;
 
   printf ("Files in the root directory:\n");
   dir = dir_open_root ();
   if (dir == NULL)
     PANIC ("root dir open failed");
+  printf ("%-14s %8s %8s %8s\n", "name", "sectors", "extents", "average");
   while (dir_readdir (dir, name))
-    printf ("%s\n", name);
+    {
+      struct inode *inode;
+      size_t sectors = 0, extents = 0;
+
+      if (dir_lookup (dir, name, &inode))
+        {
+          extents = inode_fragments (inode, &sectors);
+          inode_close (inode);
+        }
+      printf ("%-14s %8zu %8zu     ", name, sectors, extents);
+      print_average (sectors, extents);
+      printf ("\n");
+      total_sectors += sectors;
+      total_extents += extents;
+    }
 
   free (dir);
+  printf ("Average extent length: ");
+  print_average (total_sectors, total_extents);
+  printf (" sectors (%zu sectors in %zu extents).\n",
+          total_sectors, total_extents);
   printf ("End of listing.\n");
 }
 
@@ -80,7 +121,7 @@ fsutil_extract (char **argv UNUSED)
 
   /* Allocate buffers. */
   header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
+  data = malloc (FSUTIL_RUN_SECTORS * BLOCK_SECTOR_SIZE);
   if (header == NULL || data == NULL)
     PANIC ("couldn't allocate buffers");
 
@@ -100,7 +141,7 @@ fsutil_extract (char **argv UNUSED)
       int size;
 
       /* Read and parse ustar header. */
-      block_read (src, sector++, header);
+      cache_read (src, sector++, header);
       error = ustar_parse_header (header, &file_name, &type, &size);
       if (error != NULL)
         PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
@@ -125,13 +166,17 @@ fsutil_extract (char **argv UNUSED)
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
 
-          /* Do copy. */
+          /* Do copy, a run of sectors at a time. */
           while (size > 0)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
+              size_t sector_cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+              if (sector_cnt > FSUTIL_RUN_SECTORS)
+                sector_cnt = FSUTIL_RUN_SECTORS;
+              int chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
+              if (chunk_size > size)
+                chunk_size = size;
+              cache_read_multiple (src, sector, data, sector_cnt);
+              sector += sector_cnt;
               if (file_write (dst, data, chunk_size) != chunk_size)
                 PANIC ("%s: write failed with %d bytes unwritten",
                        file_name, size);
@@ -149,8 +194,8 @@ fsutil_extract (char **argv UNUSED)
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
   memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  cache_write (src, 0, header);
+  cache_write (src, 1, header);
 
   free (data);
   free (header);
@@ -167,8 +212,6 @@ fsutil_extract (char **argv UNUSED)
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
   const char *file_name = argv[1];
   void *buffer;
   struct file *src;
@@ -178,7 +221,7 @@ fsutil_append (char **argv)
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  buffer = malloc (FSUTIL_RUN_SECTORS * BLOCK_SECTOR_SIZE);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -196,18 +239,25 @@ fsutil_append (char **argv)
   /* Write ustar header to first sector. */
   if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  cache_write (dst, append_sector++, buffer);
 
-  /* Do copy. */
+  /* Do copy, a run of sectors at a time. */
   while (size > 0)
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      size_t sector_cnt = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+      if (sector_cnt > FSUTIL_RUN_SECTORS)
+        sector_cnt = FSUTIL_RUN_SECTORS;
+      int chunk_size = sector_cnt * BLOCK_SECTOR_SIZE;
+      if (chunk_size > size)
+        chunk_size = size;
+      if (append_sector + sector_cnt > block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              sector_cnt * BLOCK_SECTOR_SIZE - chunk_size);
+      cache_write_multiple (dst, append_sector, buffer, sector_cnt);
+      append_sector += sector_cnt;
       size -= chunk_size;
     }
 
@@ -215,10 +265,67 @@ fsutil_append (char **argv)
      sectors full of zeros.  Don't advance our position past
      them, though, in case we have more files to append. */
   memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
+  cache_write (dst, append_sector, buffer);
+  cache_write (dst, append_sector, buffer + 1);
 
   /* Finish up. */
   file_close (src);
   free (buffer);
 }
+
+/* Appends the block I/O trace, if tracing is on, to the ustar
+   archive on the scratch device as file "iotrace", after any
+   files written by `append'.  Called at shutdown, once the file
+   system has been flushed, so the trace goes straight to the
+   device rather than through the cache. */
+void
+fsutil_append_trace (void)
+{
+  struct block *dst;
+  uint8_t *buffer;
+  size_t size, ofs;
+
+  if (!block_trace_stop ())
+    return;
+  dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL)
+    {
+      printf ("No scratch device for block I/O trace\n");
+      return;
+    }
+  size = block_trace_size ();
+  if (append_sector + DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE) + 3
+      > block_size (dst))
+    {
+      printf ("Block I/O trace does not fit on scratch device\n");
+      return;
+    }
+
+  printf ("Appending block I/O trace to ustar archive on scratch device...\n");
+  buffer = malloc (FSUTIL_RUN_SECTORS * BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    PANIC ("couldn't allocate buffer");
+
+  ustar_make_header ("iotrace", USTAR_REGULAR, size, (char *) buffer);
+  block_write (dst, append_sector++, buffer);
+  for (ofs = 0; ofs < size; )
+    {
+      size_t chunk = size - ofs;
+      size_t sector_cnt;
+
+      if (chunk > FSUTIL_RUN_SECTORS * BLOCK_SECTOR_SIZE)
+        chunk = FSUTIL_RUN_SECTORS * BLOCK_SECTOR_SIZE;
+      sector_cnt = DIV_ROUND_UP (chunk, BLOCK_SECTOR_SIZE);
+      block_trace_read (ofs, buffer, chunk);
+      memset (buffer + chunk, 0, sector_cnt * BLOCK_SECTOR_SIZE - chunk);
+      block_write_multiple (dst, append_sector, buffer, sector_cnt);
+      append_sector += sector_cnt;
+      ofs += chunk;
+    }
+
+  /* End-of-archive marker. */
+  memset (buffer, 0, BLOCK_SECTOR_SIZE);
+  block_write (dst, append_sector, buffer);
+  block_write (dst, append_sector + 1, buffer);
+  free (buffer);
+}
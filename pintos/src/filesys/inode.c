@@ -6,11 +6,19 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/extent.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
 
-/* Identifies an inode. */
+/* Identifies an inode.  An inode with INODE_EXTENT_MAGIC maps
+   its data with extents instead of per-sector pointers. */
 #define INODE_MAGIC 0x494e4f44
+#define INODE_EXTENT_MAGIC 0x494e4f45
+
+/* Create inodes with INODE_EXTENT_MAGIC?  Set by the -extents
+   kernel option when formatting, and otherwise from the format
+   of the free map's inode when the file system is mounted. */
+bool inode_use_extents;
 
 #ifndef UNIXFFS
   #define UNIXFFS
@@ -30,6 +38,11 @@ struct inode_disk
   #define INDIRECT1_REGION_BOUND (DIRECT_REGION_BOUND + 128)
   #define INDIRECT2_REGION_BOUND (INDIRECT1_REGION_BOUND + 128*128)
 
+  /* A block map entry of INODE_MAGIC points to no sector.  A
+     data sector that is not there is a hole, which reads as
+     zeros; an index block that is not there means that all the
+     entries it would hold are holes. */
+
   struct inode_disk
     {
       off_t length;
@@ -37,9 +50,16 @@ struct inode_disk
       bool is_dir;
       bool unused[3];
       block_sector_t parent_dir;
-      block_sector_t direct[DIRECT_REGION_BOUND];
-      block_sector_t indirect;
-      block_sector_t doubly_indirect;
+      union
+        {
+          struct                        /* INODE_MAGIC. */
+            {
+              block_sector_t direct[DIRECT_REGION_BOUND];
+              block_sector_t indirect;
+              block_sector_t doubly_indirect;
+            };
+          struct extent_root extents;   /* INODE_EXTENT_MAGIC. */
+        };
     };
 #endif
 
@@ -69,16 +89,69 @@ struct inode
     #endif
     bool is_dir;
     struct lock lock;
+    struct cache_owner dirty;           /* Dirty sectors, for inode_sync(). */
   };
 
+/* Writes BUFFER to SECTOR through the cache, on INODE's behalf,
+   so that inode_sync() will write it back. */
+static void
+inode_cache_write (struct inode *inode, block_sector_t sector,
+                   const void *buffer)
+{
+  void *data = cache_get (fs_device, sector, CACHE_OVERWRITE);
+  memcpy (data, buffer, BLOCK_SECTOR_SIZE);
+  cache_put_owned (data, &inode->dirty);
+}
+
+/* Returns true if INODE maps its data with extents. */
+static inline bool
+has_extents (const struct inode *inode)
+{
+  return inode->data->magic == INODE_EXTENT_MAGIC;
+}
+
+/* Returns entry IDX of the index block in SECTOR, or
+   INODE_MAGIC if SECTOR is INODE_MAGIC, that is, if the index
+   block is not allocated and so all its entries are holes. */
+static block_sector_t
+index_get (block_sector_t sector, size_t idx)
+{
+  block_sector_t *entries, ret;
+
+  if (sector == INODE_MAGIC)
+    return INODE_MAGIC;
+  entries = cache_get (fs_device, sector, CACHE_READ);
+  ret = entries[idx];
+  cache_put (entries);
+  return ret;
+}
+
+/* Sets entry IDX of the index block in SECTOR to VALUE, on
+   INODE's behalf. */
+static void
+index_set (struct inode *inode, block_sector_t sector, size_t idx,
+           block_sector_t value)
+{
+  block_sector_t *entries = cache_get (fs_device, sector, CACHE_WRITE);
+  entries[idx] = value;
+  cache_put_owned (entries, &inode->dirty);
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or if that byte is in a hole.
+   If RUN is non-null, stores in *RUN the number of sectors,
+   starting with the one returned, that are known to follow one
+   another on disk: the rest of the extent for an inode with
+   extents, otherwise 1.  In a hole, *RUN is the number of
+   sectors known to be in the hole. */
 static block_sector_t
-byte_to_sector (const struct inode *inode, off_t pos)
+byte_to_sector (const struct inode *inode, off_t pos, size_t *run)
 {
   ASSERT (inode != NULL);
+  if (run != NULL)
+    *run = 1;
   #ifndef UNIXFFS
     if (pos < inode->data.length)
       return inode->data.start + pos / BLOCK_SECTOR_SIZE;
@@ -88,33 +161,26 @@ byte_to_sector (const struct inode *inode, off_t pos)
     if (pos < inode->data->length)
       {
         size_t sector_num = pos / BLOCK_SECTOR_SIZE;
-        if (sector_num < DIRECT_REGION_BOUND) 
-          {
-            return inode->data->direct[sector_num];
-          }
-        else if (sector_num < INDIRECT1_REGION_BOUND) 
-          {
-            sector_num -= DIRECT_REGION_BOUND;
-            block_sector_t layer1 = inode->data->indirect;
-            block_sector_t buffer[BLOCK_SECTOR_SIZE_int];
-            cache_read (fs_device, layer1, (void *) buffer);
-            return buffer[sector_num];
-          }
-        else if (sector_num < INDIRECT2_REGION_BOUND) 
+        block_sector_t sector;
+
+        if (has_extents (inode))
+          return extent_lookup (&inode->data->extents, sector_num, run);
+        else if (sector_num < DIRECT_REGION_BOUND)
+          sector = inode->data->direct[sector_num];
+        else if (sector_num < INDIRECT1_REGION_BOUND)
+          sector = index_get (inode->data->indirect,
+                              sector_num - DIRECT_REGION_BOUND);
+        else
           {
-            sector_num = sector_num - INDIRECT1_REGION_BOUND;
-            block_sector_t layer1 = inode->data->doubly_indirect;
-            block_sector_t buffer[BLOCK_SECTOR_SIZE_int];
-            cache_read (fs_device, layer1, (void *) buffer);
-            block_sector_t layer2 = buffer[sector_num / 128];
-            cache_read (fs_device, layer2, buffer);
-            return buffer[sector_num % 128];
+            sector_num -= INDIRECT1_REGION_BOUND;
+            sector = index_get (index_get (inode->data->doubly_indirect,
+                                           sector_num / 128),
+                                sector_num % 128);
           }
+        return sector != INODE_MAGIC ? sector : (block_sector_t) -1;
       }
     else
-      {
-        return -1;
-      }   
+      return -1;
   #endif
 }
 
@@ -122,208 +188,270 @@ byte_to_sector (const struct inode *inode, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* An index block whose entries are all holes, for new index
+   blocks. */
+static block_sector_t hole_block[BLOCK_SECTOR_SIZE_int];
+
 /* Initializes the inode module. */
 void
 inode_init (void)
 {
+  size_t i;
+
   list_init (&open_inodes);
+  for (i = 0; i < BLOCK_SECTOR_SIZE_int; i++)
+    hole_block[i] = INODE_MAGIC;
   cache_init ();
   lock_init (&lock_inode_list);
 }
 
 
-/* Reads the inode_disk located at sector SECTOR and frees all allocated blocks up until FAILED_SECTOR */
-void
-roll_back (block_sector_t sector, int start_sector, int failed_sector,
-           bool indirect_alloc, bool dbl_indirect_alloc, bool layer1_alloc[])
-{
-  struct inode_disk disk_inode;
-  cache_read (fs_device, sector, &disk_inode);
-  if (start_sector == 0)
-    free_map_release (sector, 1);
-  int i = start_sector;
-  for (; i < failed_sector && i < DIRECT_REGION_BOUND; i++)
-    {
-      free_map_release (disk_inode.direct[i], 1);
-    }
-  if (failed_sector >= DIRECT_REGION_BOUND && indirect_alloc)
-    {
-      int indirect[BLOCK_SECTOR_SIZE_int];
-      cache_read (fs_device, disk_inode.indirect, (void *) indirect);
-      free_map_release (disk_inode.indirect, 1);
-      for (; i < failed_sector && i < INDIRECT2_REGION_BOUND; i++)
-        {
-          free_map_release (indirect[i - INDIRECT1_REGION_BOUND], 1);
-        }
-    }
-  
-  if (failed_sector >= INDIRECT1_REGION_BOUND && dbl_indirect_alloc)
-    {
-      int layer1[BLOCK_SECTOR_SIZE_int];
-      int layer2[BLOCK_SECTOR_SIZE_int];
-      cache_read (fs_device, disk_inode.doubly_indirect, (void *) layer1);
-      free_map_release (disk_inode.doubly_indirect, 1);
-      int layer_num = 0;
-      for (; i < failed_sector; i++)
-        {
-          if (!layer1_alloc[layer_num])
-            {
-              break;
-            }
-          cache_read (fs_device, layer1[layer_num], (void *)layer2);
-          free_map_release (layer1[layer_num], 1);
-          for (int layer_index = 0; i < failed_sector && layer_index < BLOCK_SECTOR_SIZE_int;
-               i++, layer_index++)
-            {
-              free_map_release (layer2[layer_index], 1);
-            }
-          layer_num ++;
-        }
-    }
+#ifdef UNIXFFS
+/* Releases the data sectors among the first CNT entries of the
+   index block in SECTOR, skipping holes, and then the index block
+   itself, unless SECTOR is INODE_MAGIC. */
+static void
+release_index (block_sector_t sector, size_t cnt)
+{
+  block_sector_t entries[BLOCK_SECTOR_SIZE_int];
+  size_t i;
+
+  if (sector == INODE_MAGIC)
+    return;
+  cache_read (fs_device, sector, entries);
+  for (i = 0; i < cnt && i < BLOCK_SECTOR_SIZE_int; i++)
+    if (entries[i] != INODE_MAGIC)
+      free_map_release (entries[i], 1);
+  free_map_release (sector, 1);
 }
 
-#ifdef UNIXFFS
-bool inode_extend (struct inode *inode, off_t length)
+/* Releases the data and index sectors of INODE, which maps its
+   data with a block map, skipping holes. */
+static void
+release_map (struct inode *inode)
 {
-  size_t new_sectors = bytes_to_sectors (length);
-  if (new_sectors > INDIRECT2_REGION_BOUND)
+  struct inode_disk *disk_inode = inode->data;
+  size_t sectors = bytes_to_sectors (disk_inode->length);
+  size_t i;
+
+  for (i = 0; i < sectors && i < DIRECT_REGION_BOUND; i++)
+    if (disk_inode->direct[i] != INODE_MAGIC)
+      free_map_release (disk_inode->direct[i], 1);
+  if (sectors > DIRECT_REGION_BOUND)
+    release_index (disk_inode->indirect, sectors - DIRECT_REGION_BOUND);
+  if (sectors > INDIRECT1_REGION_BOUND
+      && disk_inode->doubly_indirect != INODE_MAGIC)
     {
-      return false;
+      block_sector_t layer1[BLOCK_SECTOR_SIZE_int];
+
+      sectors -= INDIRECT1_REGION_BOUND;
+      cache_read (fs_device, disk_inode->doubly_indirect, layer1);
+      for (i = 0; i * 128 < sectors; i++)
+        release_index (layer1[i], sectors - i * 128);
+      free_map_release (disk_inode->doubly_indirect, 1);
     }
-  size_t cur_sectors = bytes_to_sectors (inode_length (inode));
-  if (new_sectors == cur_sectors)
+}
+
+/* Returns the sector after the one that holds file sector
+   SECTOR_NUM - 1 of INODE, or after INODE itself if that sector
+   is a hole too, as the place to look first for a sector to fill
+   a hole at SECTOR_NUM. */
+static block_sector_t
+hole_goal (const struct inode *inode, size_t sector_num)
+{
+  block_sector_t prev = (sector_num > 0
+                         ? byte_to_sector (inode,
+                                           (sector_num - 1) * BLOCK_SECTOR_SIZE,
+                                           NULL)
+                         : (block_sector_t) -1);
+  return (prev != (block_sector_t) -1 ? prev : inode->sector) + 1;
+}
+
+/* Sectors allocated together by a write, to be handed out one at
+   a time to a block-map inode's data and index blocks. */
+struct sector_run
+  {
+    block_sector_t next;        /* Next sector to hand out. */
+    size_t cnt;                 /* Sectors left to hand out. */
+  };
+
+/* Stores a sector from RUN into *SECTORP.  If RUN is empty,
+   first refills it with up to WANT sectors allocated at RUN's
+   next sector, or as near there as possible.  Returns false if
+   no sector is free. */
+static bool
+run_take (struct sector_run *run, size_t want, block_sector_t *sectorp)
+{
+  if (run->cnt == 0)
     {
-      inode->data->length = length;
-      cache_write (fs_device, inode->sector, inode->data);
-      return true;
+      run->cnt = free_map_allocate_near (run->next, want, &run->next);
+      if (run->cnt == 0)
+        return false;
     }
-  static char zeros[BLOCK_SECTOR_SIZE];
-  static block_sector_t magic[BLOCK_SECTOR_SIZE_int];
-  for (int i = 0; i < BLOCK_SECTOR_SIZE_int; i++)
-    magic[i] = INODE_MAGIC;
+  *sectorp = run->next++;
+  run->cnt--;
+  return true;
+}
+
+/* Takes a sector from RUN, as run_take() does, for an index block
+   of INODE in which every entry is a hole, and stores it in
+   *SECTORP.  Returns false if no sector is free. */
+static bool
+new_index (struct inode *inode, struct sector_run *run, size_t want,
+           block_sector_t *sectorp)
+{
+  if (!run_take (run, want, sectorp))
+    return false;
+  inode_cache_write (inode, *sectorp, hole_block);
+  return true;
+}
+
+/* Fills the hole at file sector SECTOR_NUM of INODE, which maps
+   its data with a block map, with a sector taken from RUN,
+   allocating the index blocks needed to point to it.  The new
+   sector is not initialized: the caller must write all of it.  WANT is the
+   number of sectors the write needs from here on, so that they
+   can be allocated together.  Returns the new sector, or -1 if
+   the disk is full; index blocks already allocated then stay,
+   full of holes. */
+static block_sector_t
+fill_hole_map (struct inode *inode, size_t sector_num, size_t want,
+               struct sector_run *run)
+{
   struct inode_disk *disk_inode = inode->data;
-  bool rollback = false;
-  bool indirect_alloc = false;
-  bool dbl_indr_alloc = false;
-  bool layer1_alloc[BLOCK_SECTOR_SIZE_int];
-  memset (layer1_alloc, 0, BLOCK_SECTOR_SIZE_int * sizeof (bool));
-  size_t i;
+  block_sector_t index, sector;
+  size_t idx;
 
-  for (i = cur_sectors; i < DIRECT_REGION_BOUND && i < new_sectors; i++)
+  if (run->cnt == 0)
+    run->next = hole_goal (inode, sector_num);
+
+  if (sector_num < DIRECT_REGION_BOUND)
     {
-      if (!free_map_allocate (1, disk_inode->direct + i))
-        {
-          rollback = true;
-          cache_write (fs_device, inode->sector, disk_inode);
-          goto fail_extend;
-        }
-      cache_write (fs_device, disk_inode->direct[i], zeros);
+      if (!run_take (run, want, &sector))
+        return -1;
+      disk_inode->direct[sector_num] = sector;
+      inode_cache_write (inode, inode->sector, disk_inode);
+      return sector;
     }
-
-  if (i >= DIRECT_REGION_BOUND && i < new_sectors)
+  else if (sector_num < INDIRECT1_REGION_BOUND)
     {
       if (disk_inode->indirect == INODE_MAGIC)
         {
-          if (!free_map_allocate (1, &disk_inode->indirect))
-            {
-              rollback = true;
-              cache_write (fs_device, inode->sector, disk_inode);
-              goto fail_extend;
-            }
-          indirect_alloc = true;
-          cache_write (fs_device, inode->sector, disk_inode);
+          if (!new_index (inode, run, want + 1, &disk_inode->indirect))
+            return -1;
+          inode_cache_write (inode, inode->sector, disk_inode);
         }
-      block_sector_t buffer[BLOCK_SECTOR_SIZE_int];
-      cache_read (fs_device, disk_inode->indirect, (void *) buffer);
-      for (; i < INDIRECT1_REGION_BOUND && i < new_sectors; i++)
-        {
-          if (!free_map_allocate (1, buffer + i - DIRECT_REGION_BOUND))
-            {
-              rollback = true;
-              cache_write (fs_device, disk_inode->indirect, (void *) buffer);
-              cache_write (fs_device, inode->sector, disk_inode);
-              goto fail_extend;
-            }
-          cache_write (fs_device, buffer[i - DIRECT_REGION_BOUND], zeros);
-        }
-      cache_write (fs_device, disk_inode->indirect, (void *) buffer);
+      index = disk_inode->indirect;
+      idx = sector_num - DIRECT_REGION_BOUND;
     }
-
-  if (i >= INDIRECT1_REGION_BOUND && i < new_sectors)
+  else
     {
+      sector_num -= INDIRECT1_REGION_BOUND;
       if (disk_inode->doubly_indirect == INODE_MAGIC)
         {
-          if (!free_map_allocate (1, &disk_inode->doubly_indirect))
-            {
-              rollback = true;
-              cache_write (fs_device, inode->sector, disk_inode);
-              goto fail_extend;
-            }
-          cache_write (fs_device, inode->sector, disk_inode);
-          cache_write (fs_device, disk_inode->doubly_indirect, (void *) magic);
-          dbl_indr_alloc = true;
+          if (!new_index (inode, run, want + 2,
+                          &disk_inode->doubly_indirect))
+            return -1;
+          inode_cache_write (inode, inode->sector, disk_inode);
         }
-
-      size_t layer_num = (i - INDIRECT1_REGION_BOUND) / 128;
-      block_sector_t buffer_l1[BLOCK_SECTOR_SIZE_int];
-      cache_read (fs_device, disk_inode->doubly_indirect, (void *) buffer_l1);
-      block_sector_t buffer_l2[BLOCK_SECTOR_SIZE_int];
-      while (i < new_sectors)
+      index = index_get (disk_inode->doubly_indirect, sector_num / 128);
+      if (index == INODE_MAGIC)
         {
-          if (buffer_l1[layer_num] == INODE_MAGIC)
-            {
-              if (!free_map_allocate (1, &buffer_l1[layer_num]))
-                {
-                  rollback = true;
-                  cache_write (fs_device, disk_inode->doubly_indirect, (void *) buffer_l1);
-                  cache_write (fs_device, inode->sector, disk_inode);
-                  goto fail_extend;
-                }
-              cache_write (fs_device, buffer_l1[layer_num], (void *) magic);
-              layer1_alloc[layer_num] = true;
-            }
-
-          cache_read (fs_device, buffer_l1[layer_num], (void *) buffer_l2);
-          for (int layer_index = (i - INDIRECT1_REGION_BOUND) % 128; layer_index < BLOCK_SECTOR_SIZE_int && i < new_sectors; layer_index++, i++)
-            {
-              if (buffer_l2[layer_index] == INODE_MAGIC)
-                {
-                  if (!free_map_allocate (1, buffer_l2 + layer_index))
-                    {
-                      rollback = true;
-                      cache_write (fs_device, buffer_l1[layer_num], (void *) buffer_l2);
-                      cache_write (fs_device, disk_inode->doubly_indirect, (void *) buffer_l1);
-                      cache_write (fs_device, inode->sector, disk_inode);
-                      goto fail_extend;
-                    }
-                  cache_write (fs_device, buffer_l2[layer_index], zeros);
-                }
-            }
-          cache_write (fs_device, buffer_l1[layer_num], (void *) buffer_l2);
-          layer_num ++;
+          if (!new_index (inode, run, want + 1, &index))
+            return -1;
+          index_set (inode, disk_inode->doubly_indirect, sector_num / 128,
+                     index);
         }
-      cache_write (fs_device, disk_inode->doubly_indirect, (void *) buffer_l1);
+      idx = sector_num % 128;
     }
 
-  inode->data->length = length;
-  cache_write (fs_device, inode->sector, disk_inode);
+  if (!run_take (run, want, &sector))
+    return -1;
+  index_set (inode, index, idx, sector);
+  return sector;
+}
 
-fail_extend:
-  if (rollback)
-  {
-    roll_back (inode->sector, cur_sectors, i, indirect_alloc, dbl_indr_alloc, layer1_alloc);
-    return false;
-  }
+/* Fills the hole at file sector SECTOR_NUM of INODE, which maps
+   its data with extents, with new sectors: as many of the WANT
+   sectors that a write needs from here on as are in the hole, or
+   as many of those as the free map has in one run.  They become
+   one extent, and their number is stored in *CNTP.  The new
+   sectors are not initialized: the caller must write all of
+   them.  Returns the sector that now holds SECTOR_NUM, or -1 if
+   the disk is full. */
+static block_sector_t
+fill_hole_extents (struct inode *inode, size_t sector_num, size_t want,
+                   size_t *cntp)
+{
+  struct inode_disk *disk_inode = inode->data;
+  block_sector_t start;
+  size_t hole, cnt;
+  bool success;
+
+  extent_lookup (&disk_inode->extents, sector_num, &hole);
+  if (want > hole)
+    want = hole;
+  cnt = free_map_allocate_near (hole_goal (inode, sector_num), want, &start);
+  if (cnt == 0)
+    return -1;
+  success = extent_insert (&disk_inode->extents, &inode->dirty, sector_num,
+                           start, cnt);
+  inode_cache_write (inode, inode->sector, disk_inode);
+  if (!success)
+    {
+      free_map_release (start, cnt);
+      return -1;
+    }
+  *cntp = cnt;
+  return start;
+}
+
+/* Extends INODE to LENGTH bytes.  The new bytes are a hole: they
+   read as zeros, and sectors to hold them are allocated only when
+   they are written, by inode_write_at(). */
+bool inode_extend (struct inode *inode, off_t length)
+{
+  struct inode_disk *disk_inode = inode->data;
+
+  if (!has_extents (inode))
+    {
+      size_t cur_sectors = bytes_to_sectors (disk_inode->length);
+      size_t new_sectors = bytes_to_sectors (length);
+      size_t i;
+
+      if (new_sectors > INDIRECT2_REGION_BOUND)
+        return false;
+      for (i = cur_sectors; i < new_sectors && i < DIRECT_REGION_BOUND; i++)
+        disk_inode->direct[i] = INODE_MAGIC;
 
+      /* Index blocks start out full of holes, but one written
+         before files could have holes has garbage past the old
+         end of file. */
+      if (i < new_sectors && i < INDIRECT1_REGION_BOUND
+          && disk_inode->indirect != INODE_MAGIC)
+        {
+          block_sector_t *entries = cache_get (fs_device,
+                                               disk_inode->indirect,
+                                               CACHE_WRITE);
+          for (; i < new_sectors && i < INDIRECT1_REGION_BOUND; i++)
+            entries[i - DIRECT_REGION_BOUND] = INODE_MAGIC;
+          cache_put_owned (entries, &inode->dirty);
+        }
+    }
+
+  disk_inode->length = length;
+  inode_cache_write (inode, inode->sector, disk_inode);
   return true;
 }
 #endif
 
 /* Initializes an inode with LENGTH bytes of data and
    writes the new inode to sector SECTOR on the file system
-   device.
+   device.  The data is a hole, so no sectors are allocated for
+   it until it is written.
    Returns true if successful.
-   Returns false if memory or disk allocation fails. */
+   Returns false if memory allocation fails or LENGTH is too
+   long. */
 bool
 inode_create (block_sector_t sector, off_t length, bool is_dir)
 {
@@ -357,20 +485,29 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
             success = true;
           }
       #else
-        if (sectors >= INDIRECT2_REGION_BOUND)
-          return -1;
-
         disk_inode->length = 0;
-        disk_inode->indirect = INODE_MAGIC;
-        disk_inode->doubly_indirect = INODE_MAGIC;
         disk_inode->is_dir = is_dir;
+        if (inode_use_extents)
+          {
+            disk_inode->magic = INODE_EXTENT_MAGIC;
+            extent_init (&disk_inode->extents);
+          }
+        else
+          {
+            if (sectors >= INDIRECT2_REGION_BOUND)
+              return -1;
+            disk_inode->indirect = INODE_MAGIC;
+            disk_inode->doubly_indirect = INODE_MAGIC;
+          }
 
         struct inode inode;
         inode.sector = sector;
         inode.data = disk_inode;
         lock_init (&inode.lock);
+        cache_owner_init (&inode.dirty);
 
         success = inode_extend (&inode, length);
+        cache_owner_release (&inode.dirty);
 
       #endif
       free (disk_inode);
@@ -416,6 +553,7 @@ inode_open (block_sector_t sector)
   inode->deny_write_cnt = 0;
   inode->removed = false;
   lock_init (&inode->lock);
+  cache_owner_init (&inode->dirty);
   #ifndef UNIXFFS
     cache_read (fs_device, inode->sector, &inode->data);
   #else
@@ -472,11 +610,19 @@ inode_close (struct inode *inode)
             free_map_release (inode->data.start,
                             bytes_to_sectors (inode->data.length));
           #else
-            bool layer1_alloc[BLOCK_SECTOR_SIZE_int];
-            memset (layer1_alloc, 1, (sizeof (bool)) * BLOCK_SECTOR_SIZE_int);
-            roll_back (inode->sector, 0, bytes_to_sectors (inode->data->length), true, true, layer1_alloc);
+            if (has_extents (inode))
+              {
+                extent_release (&inode->data->extents, &inode->dirty, 0);
+                free_map_release (inode->sector, 1);
+              }
+            else
+              {
+                release_map (inode);
+                free_map_release (inode->sector, 1);
+              }
           #endif
         }
+      cache_owner_release (&inode->dirty);
       #ifdef UNIXFFS
         free (inode->data);
       #endif
@@ -500,18 +646,23 @@ inode_remove (struct inode *inode)
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
+   than SIZE if an error occurs or end of file is reached.
+   INODE's lock is held only while looking up sectors, not during
+   I/O, so that readers of one file can wait for the disk at the
+   same time.  A writer holds the lock until every sector it
+   allocates is in the cache, so a reader never sees one before
+   its data. */
 off_t
 inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
-  lock_acquire (&inode->lock);
   while (size > 0)
     {
       /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      size_t known_run;
+      lock_acquire (&inode->lock);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, &known_run);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -522,25 +673,60 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
       if (chunk_size <= 0)
-        break;
+        {
+          lock_release (&inode->lock);
+          break;
+        }
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
+      /* Count the whole sectors from here on that follow each
+         other on disk, so that they can be read as a run.  An
+         extent says how far its run goes, so that those sectors
+         need not be looked up one by one. */
+      size_t run = 1;
+      if (sector_idx != (block_sector_t) -1
+          && sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
         {
-          /* Read full sector directly into caller's buffer. */
-          cache_read (fs_device, sector_idx, buffer + bytes_read);
+          size_t max_run = BLOCK_MAX_RUN;
+          if ((off_t) max_run > size / BLOCK_SECTOR_SIZE)
+            max_run = size / BLOCK_SECTOR_SIZE;
+          if ((off_t) max_run > inode_left / BLOCK_SECTOR_SIZE)
+            max_run = inode_left / BLOCK_SECTOR_SIZE;
+
+          run = known_run < max_run ? known_run : max_run;
+          while (run < max_run
+                 && (byte_to_sector (inode, offset + run * BLOCK_SECTOR_SIZE,
+                                     NULL)
+                     == sector_idx + run))
+            run++;
         }
-      else
+      lock_release (&inode->lock);
+
+      if (sector_idx == (block_sector_t) -1)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL)
+          /* A hole reads as zeros, without I/O.  An extent map
+             says how long the hole is. */
+          uint64_t hole_left = ((uint64_t) known_run * BLOCK_SECTOR_SIZE
+                                - sector_ofs);
+          if ((uint64_t) chunk_size < hole_left)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              chunk_size = size < inode_left ? size : inode_left;
+              if ((uint64_t) chunk_size > hole_left)
+                chunk_size = hole_left;
             }
-          cache_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          memset (buffer + bytes_read, 0, chunk_size);
+        }
+      else if (run > 1)
+        {
+          cache_read_multiple (fs_device, sector_idx, buffer + bytes_read,
+                               run);
+          chunk_size = run * BLOCK_SECTOR_SIZE;
+        }
+      else
+        {
+          /* Copy straight out of the cache into caller's buffer. */
+          uint8_t *data = cache_get (fs_device, sector_idx, CACHE_READ);
+          memcpy (buffer + bytes_read, data + sector_ofs, chunk_size);
+          cache_put (data);
         }
 
       /* Advance. */
@@ -548,23 +734,42 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
-  lock_release (&inode->lock);
   return bytes_read;
 }
 
+/* Queues the sectors that hold the SIZE bytes of INODE starting
+   at OFFSET, which must be sector-aligned, for read-ahead.
+   Bytes past end of file are ignored. */
+void
+inode_readahead (struct inode *inode, off_t offset, off_t size)
+{
+  ASSERT (offset % BLOCK_SECTOR_SIZE == 0);
+
+  lock_acquire (&inode->lock);
+  off_t end = offset + size;
+  if (end > inode_length (inode))
+    end = inode_length (inode);
+  for (; offset < end; offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector = byte_to_sector (inode, offset, NULL);
+      if (sector != (block_sector_t) -1)
+        cache_readahead (fs_device, sector);
+    }
+  lock_release (&inode->lock);
+}
+
 /* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
    Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
+   less than SIZE if the disk fills up or an error occurs.
+   A write past end of file extends the inode, leaving a hole
+   between the old end and OFFSET.  Sectors are allocated for
+   holes as the write reaches them. */
 off_t
 inode_write_at (struct inode *inode, const void *buffer_, off_t size,
                 off_t offset)
 {
   const uint8_t *buffer = buffer_;
   off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
   lock_acquire (&inode->lock);
   if (inode->deny_write_cnt)
     {
@@ -573,6 +778,10 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
     }
 
   #ifdef UNIXFFS
+    struct sector_run run = { 0, 0 };
+    bool filled = false;
+    size_t fresh_start = 0, fresh_end = 0;
+    off_t old_length = inode_length (inode);
     off_t new_length = offset + size;
     if (new_length > inode_length (inode) && !inode_extend (inode, new_length))
       {
@@ -584,7 +793,7 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
   while (size > 0)
     {
       /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
+      block_sector_t sector_idx = byte_to_sector (inode, offset, NULL);
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
@@ -597,42 +806,110 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          cache_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL)
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+      /* Is this a sector just allocated for a hole, whose old
+         contents are garbage? */
+      bool fresh = false;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left)
-            cache_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          cache_write (fs_device, sector_idx, bounce);
-        }
+      #ifdef UNIXFFS
+        /* Give a hole the sectors it needs now. */
+        size_t sector_num = offset / BLOCK_SECTOR_SIZE;
+        if (sector_idx == (block_sector_t) -1)
+          {
+            size_t want = DIV_ROUND_UP (sector_ofs + size, BLOCK_SECTOR_SIZE);
+            size_t cnt = 1;
+            if (has_extents (inode))
+              sector_idx = fill_hole_extents (inode, sector_num, want, &cnt);
+            else
+              sector_idx = fill_hole_map (inode, sector_num, want, &run);
+            filled = true;
+            if (sector_idx == (block_sector_t) -1)
+              break;
+            fresh_start = sector_num;
+            fresh_end = sector_num + cnt;
+          }
+        fresh = sector_num >= fresh_start && sector_num < fresh_end;
+      #endif
+
+      /* Copy straight from caller's buffer into the cache.  If
+         the sector contains data before or after the chunk
+         we're writing, then the cache must read it in first,
+         unless the sector is fresh, when that data is zeros.
+         Only the first and last sectors of a write can be
+         partly covered, so only those get zeroed. */
+      bool whole = sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE;
+      enum cache_mode mode = whole || fresh ? CACHE_OVERWRITE : CACHE_WRITE;
+      uint8_t *data = cache_get (fs_device, sector_idx, mode);
+      if (fresh && !whole)
+        memset (data, 0, BLOCK_SECTOR_SIZE);
+      memcpy (data + sector_ofs, buffer + bytes_written, chunk_size);
+      cache_put_owned (data, &inode->dirty);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
+
+  #ifdef UNIXFFS
+    /* Give back sectors allocated ahead but not used.  If the
+       disk filled up, don't leave the file longer than what was
+       written. */
+    if (run.cnt > 0)
+      free_map_release (run.next, run.cnt);
+    if (size > 0 && inode->data->length > old_length)
+      {
+        inode->data->length = offset > old_length ? offset : old_length;
+        inode_cache_write (inode, inode->sector, inode->data);
+      }
+  #endif
   lock_release (&inode->lock);
+
+  #ifdef UNIXFFS
+    /* Write the free map once for the whole write.  This must
+       wait until INODE is unlocked, because it writes the free
+       map file, which might be INODE. */
+    if (filled)
+      free_map_flush ();
+  #endif
   return bytes_written;
 }
 
+/* Writes INODE's dirty data sectors back to disk, in ascending
+   sector order, followed by its inode and indirect blocks, and
+   waits for them to get there. */
+void
+inode_sync (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  cache_sync (&inode->dirty);
+  cache_sync_sector (fs_device, inode->sector);
+  #ifdef UNIXFFS
+    /* Extent tree nodes are on the dirty list with the data, so
+       only a block map's indirect blocks need syncing here. */
+    struct inode_disk *disk_inode = inode->data;
+    if (!has_extents (inode))
+      {
+        if (disk_inode->indirect != INODE_MAGIC)
+          cache_sync_sector (fs_device, disk_inode->indirect);
+        if (disk_inode->doubly_indirect != INODE_MAGIC)
+          {
+            block_sector_t *layer1 = cache_get (fs_device,
+                                                disk_inode->doubly_indirect,
+                                                CACHE_READ);
+            block_sector_t layer2_sectors[BLOCK_SECTOR_SIZE_int];
+            memcpy (layer2_sectors, layer1, sizeof layer2_sectors);
+            cache_put (layer1);
+
+            for (int i = 0; i < BLOCK_SECTOR_SIZE_int; i++)
+              if (layer2_sectors[i] != INODE_MAGIC)
+                cache_sync_sector (fs_device, layer2_sectors[i]);
+            cache_sync_sector (fs_device, disk_inode->doubly_indirect);
+          }
+      }
+  #endif
+  lock_release (&inode->lock);
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
@@ -674,6 +951,51 @@ inode_length (const struct inode *inode)
   #endif
 }
 
+/* Returns true if INODE maps its data with extents. */
+bool
+inode_has_extents (struct inode *inode)
+{
+  lock_acquire (&inode->lock);
+  bool ret = has_extents (inode);
+  lock_release (&inode->lock);
+  return ret;
+}
+
+/* Returns the number of runs of consecutive disk sectors that
+   hold INODE's data, and stores the number of data sectors in
+   *SECTOR_CNT.  A file laid out in one piece has one run. */
+size_t
+inode_fragments (struct inode *inode, size_t *sector_cnt)
+{
+  size_t runs = 0, sectors = 0;
+  block_sector_t prev = -1;
+  size_t i, total;
+
+  lock_acquire (&inode->lock);
+  total = bytes_to_sectors (inode->data->length);
+  for (i = 0; i < total; )
+    {
+      size_t run;
+      block_sector_t sector = byte_to_sector (inode, i * BLOCK_SECTOR_SIZE,
+                                              &run);
+
+      if (run > total - i)
+        run = total - i;
+      if (sector != (block_sector_t) -1)
+        {
+          if (sector != prev + 1)
+            runs++;
+          prev = sector + run - 1;
+          sectors += run;
+        }
+      i += run;
+    }
+  lock_release (&inode->lock);
+
+  *sector_cnt = sectors;
+  return runs;
+}
+
 /* Returns the sector of the inode */
 block_sector_t
 get_inode_sector (struct inode *inode)
@@ -708,7 +1030,7 @@ set_inode_parent (block_sector_t parent_sector, block_sector_t inode_sector)
   struct inode *inode = inode_open (inode_sector);
   lock_acquire (&inode->lock);
   inode->data->parent_dir = parent_sector;
-  cache_write (fs_device, inode_sector, inode->data);
+  inode_cache_write (inode, inode_sector, inode->data);
   lock_release (&inode->lock);
   inode_close (inode);
 }
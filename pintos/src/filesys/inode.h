@@ -7,6 +7,8 @@
 
 struct bitmap;
 
+extern bool inode_use_extents;
+
 void inode_init (void);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
@@ -15,10 +17,14 @@ block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
+void inode_readahead (struct inode *, off_t offset, off_t size);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+void inode_sync (struct inode *);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
+bool inode_has_extents (struct inode *);
+size_t inode_fragments (struct inode *, size_t *sector_cnt);
 
 // OUR CHANGES
 block_sector_t get_inode_sector (struct inode *);
@@ -0,0 +1,49 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+/* Block device statistics, as returned by the block_stats()
+   system call.
+
+   Versioned like struct cache_stats: the caller sets SIZE to the
+   size of its structure, and the kernel fills in at most that
+   many bytes and sets VERSION and SIZE to describe what it
+   filled in.
+
+   Times are in CPU time-stamp counter cycles.  A request's
+   latency runs from its submission to the block layer until its
+   completion, so it includes time spent waiting in the device's
+   queue.  A partition sees the same requests, with the same
+   latencies, as the disk it is on. */
+
+#include <stdint.h>
+
+#define BLOCK_STATS_VERSION 1
+
+/* Latency histogram buckets.  Bucket I counts requests whose
+   latency L had floor(log2(L)) == I; the last bucket also counts
+   all longer ones. */
+#define BLOCK_STATS_BUCKETS 32
+
+struct block_stats
+  {
+    uint32_t version;           /* BLOCK_STATS_VERSION. */
+    uint32_t size;              /* Bytes of this structure filled in. */
+
+    /* Version 1. */
+    char name[16];              /* Device name, e.g. "hdb1". */
+    uint64_t reads;             /* Sectors read. */
+    uint64_t read_requests;     /* Read requests submitted. */
+    uint64_t writes;            /* Sectors written. */
+    uint64_t write_requests;    /* Write requests submitted. */
+    uint64_t elapsed_cycles;    /* Time since the device was registered. */
+    uint64_t elapsed_ms;        /* The same, in milliseconds of timer ticks. */
+    uint64_t busy_cycles;       /* Time with any request outstanding. */
+    uint64_t depth_cycles;      /* Sum over time of requests outstanding;
+                                   divide by ELAPSED_CYCLES for the average
+                                   queue depth. */
+    uint64_t latency_cycles;    /* Total latency of completed requests. */
+    uint64_t read_latency[BLOCK_STATS_BUCKETS];  /* Completed reads. */
+    uint64_t write_latency[BLOCK_STATS_BUCKETS]; /* Completed writes. */
+  };
+
+#endif /* lib/block-stats.h */
@@ -0,0 +1,41 @@
+#ifndef __LIB_CACHE_STATS_H
+#define __LIB_CACHE_STATS_H
+
+/* Buffer cache and file system device statistics, as returned
+   by the cache_stats() system call.
+
+   The structure is versioned so that programs built against an
+   older layout keep working.  The caller sets SIZE to the size
+   of its structure; the kernel fills in at most that many bytes
+   and sets VERSION and SIZE to describe what it filled in.  New
+   members are only ever added at the end, bumping
+   CACHE_STATS_VERSION. */
+
+#include <stdint.h>
+
+#define CACHE_STATS_VERSION 1
+
+struct cache_stats
+  {
+    uint32_t version;           /* CACHE_STATS_VERSION. */
+    uint32_t size;              /* Bytes of this structure filled in. */
+
+    /* Version 1. */
+    uint32_t sectors;           /* Current cache size, in sectors. */
+    uint32_t max_sectors;       /* Cache size at boot, in sectors. */
+    uint64_t hits;              /* Lookups found in the cache. */
+    uint64_t misses;            /* Lookups that needed a block. */
+    uint64_t evictions;         /* Valid blocks evicted. */
+    uint64_t dirty_evictions;   /* ...that had to be written first. */
+    uint64_t eviction_cycles;   /* Total TSC cycles spent evicting. */
+    uint64_t write_backs;       /* Dirty blocks written to disk. */
+    uint64_t read_modify_writes; /* Partial writes of a sector. */
+    uint64_t readahead_issued;  /* Sectors read ahead. */
+    uint64_t readahead_used;    /* ...later used by a reader. */
+    uint64_t readahead_wasted;  /* ...evicted without use. */
+    uint64_t reclaimed_pages;   /* Pages given back to the kernel pool. */
+    uint64_t device_reads;      /* Sectors read from the file system device. */
+    uint64_t device_writes;     /* Sectors written to it. */
+  };
+
+#endif /* lib/cache-stats.h */
@@ -3,6 +3,8 @@
 #include <limits.h>
 #include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
 #ifdef FILESYS
 #include "filesys/file.h"
@@ -23,11 +25,18 @@ typedef unsigned long elem_type;
 
 /* From the outside, a bitmap is an array of bits.  From the
    inside, it's an array of elem_type (defined above) that
-   simulates an array of bits. */
+   simulates an array of bits.
+
+   A bitmap may also have a summary, a second level with one bit
+   per element of BITS that is set if that element has at least
+   one bit set to false.  Searches for false bits, which is how
+   the free map and the page allocator look for free sectors and
+   pages, use it to skip over full elements 32 at a time. */
 struct bitmap
   {
     size_t bit_cnt;     /* Number of bits. */
     elem_type *bits;    /* Elements that represent bits. */
+    elem_type *summary; /* Summary of BITS, or a null pointer. */
   };
 
 /* Returns the index of the element that contains the bit
@@ -68,6 +77,143 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns a bit mask in which the bits actually used in element
+   IDX of B's bits are set to 1 and the rest are set to 0. */
+static inline elem_type
+used_mask (const struct bitmap *b, size_t idx)
+{
+  return idx == elem_cnt (b->bit_cnt) - 1 ? last_mask (b) : (elem_type) -1;
+}
+
+/* Returns the number of bytes required for the summary of a
+   bitmap with BIT_CNT bits. */
+static inline size_t
+summary_byte_cnt (size_t bit_cnt)
+{
+  return byte_cnt (elem_cnt (bit_cnt));
+}
+
+/* Returns the index of the lowest bit set in E, which must be
+   nonzero.  This compiles to a single BSF instruction. */
+static inline size_t
+lowest_bit (elem_type e)
+{
+  return __builtin_ctzl (e);
+}
+
+/* Returns the number of bits set in E. */
+static inline size_t
+count_bits (elem_type e)
+{
+  size_t cnt = 0;
+
+  for (; e != 0; e &= e - 1)
+    cnt++;
+  return cnt;
+}
+
+/* Brings the summary bit for element IDX of B up to date, if B
+   has a summary.  Looking at the element and updating its
+   summary bit are done together, so that whichever of two
+   threads changing the element updates the summary last sees
+   the other's change too. */
+static void
+update_summary (struct bitmap *b, size_t idx)
+{
+  if (b->summary != NULL)
+    {
+      enum intr_level old_level = intr_disable ();
+      if ((b->bits[idx] | ~used_mask (b, idx)) != (elem_type) -1)
+        b->summary[elem_idx (idx)] |= bit_mask (idx);
+      else
+        b->summary[elem_idx (idx)] &= ~bit_mask (idx);
+      intr_set_level (old_level);
+    }
+}
+
+/* Recomputes all of B's summary, if it has one. */
+static void
+summarize (struct bitmap *b)
+{
+  if (b->summary != NULL)
+    {
+      size_t idx;
+
+      memset (b->summary, 0, summary_byte_cnt (b->bit_cnt));
+      for (idx = 0; idx < elem_cnt (b->bit_cnt); idx++)
+        update_summary (b, idx);
+    }
+}
+
+/* Atomically sets the bits in MASK in element IDX of B to
+   VALUE. */
+static void
+set_elem (struct bitmap *b, size_t idx, elem_type mask, bool value)
+{
+  /* Equivalent to `b->bits[idx] |= mask' or `b->bits[idx] &=
+     ~mask', but atomic, as in bitmap_mark() and
+     bitmap_reset(). */
+  if (value)
+    asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  else
+    asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
+}
+
+/* Returns the index of the first element at or after IDX, and
+   before LIMIT, whose summary bit in B is set, or LIMIT if there
+   is none.  B must have a summary. */
+static size_t
+next_summarized (const struct bitmap *b, size_t idx, size_t limit)
+{
+  size_t s;
+  elem_type e;
+
+  if (idx >= limit)
+    return limit;
+  s = elem_idx (idx);
+  e = b->summary[s] & ((elem_type) -1 << (idx % ELEM_BITS));
+  while (e == 0)
+    {
+      if (++s * ELEM_BITS >= limit)
+        return limit;
+      e = b->summary[s];
+    }
+  idx = s * ELEM_BITS + lowest_bit (e);
+  return idx < limit ? idx : limit;
+}
+
+/* Returns the index of the first bit in B at or after START, and
+   before END, that is set to VALUE, or END if there is none.
+   Examines a whole element at a time.  When looking for a false
+   bit in a bitmap with a summary, also skips elements that have
+   none without reading them. */
+static size_t
+find_bit (const struct bitmap *b, size_t start, size_t end, bool value)
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx, last_idx;
+  elem_type e;
+
+  if (start >= end)
+    return end;
+  idx = elem_idx (start);
+  last_idx = elem_idx (end - 1);
+  e = (b->bits[idx] ^ flip) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (e == 0)
+    {
+      if (!value && b->summary != NULL)
+        idx = next_summarized (b, idx + 1, last_idx + 1);
+      else
+        idx++;
+      if (idx > last_idx)
+        return end;
+      e = b->bits[idx] ^ flip;
+    }
+  start = idx * ELEM_BITS + lowest_bit (e);
+  return start < end ? start : end;
+}
 
 /* Creation and destruction. */
 
@@ -83,6 +229,7 @@ bitmap_create (size_t bit_cnt)
     {
       b->bit_cnt = bit_cnt;
       b->bits = malloc (byte_cnt (bit_cnt));
+      b->summary = NULL;
       if (b->bits != NULL || bit_cnt == 0)
         {
           bitmap_set_all (b, false);
@@ -95,7 +242,10 @@ bitmap_create (size_t bit_cnt)
 
 /* Creates and returns a bitmap with BIT_CNT bits in the
    BLOCK_SIZE bytes of storage preallocated at BLOCK.
-   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT). */
+   BLOCK_SIZE must be at least bitmap_needed_bytes(BIT_CNT).
+   The bitmap has a summary, which also lives in BLOCK, because
+   the page allocator's bitmaps are made this way before malloc()
+   is available. */
 struct bitmap *
 bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 {
@@ -105,6 +255,8 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 
   b->bit_cnt = bit_cnt;
   b->bits = (elem_type *) (b + 1);
+  b->summary = b->bits + elem_cnt (bit_cnt);
+  memset (b->summary, 0, summary_byte_cnt (bit_cnt));
   bitmap_set_all (b, false);
   return b;
 }
@@ -114,7 +266,29 @@ bitmap_create_in_buf (size_t bit_cnt, void *block, size_t block_size UNUSED)
 size_t
 bitmap_buf_size (size_t bit_cnt)
 {
-  return sizeof (struct bitmap) + byte_cnt (bit_cnt);
+  return (sizeof (struct bitmap) + byte_cnt (bit_cnt)
+          + summary_byte_cnt (bit_cnt));
+}
+
+/* Adds a summary to B, which must not have one, so that
+   searching it for false bits no longer has to look at every
+   element that has none.  This is worthwhile for large bitmaps
+   that are searched often, at the cost of a little more work
+   each time a bit changes.  Returns true if successful, false if
+   memory allocation fails. */
+bool
+bitmap_enable_summary (struct bitmap *b)
+{
+  ASSERT (b != NULL);
+  ASSERT (b->summary == NULL);
+
+  if (b->bit_cnt == 0)
+    return true;
+  b->summary = malloc (summary_byte_cnt (b->bit_cnt));
+  if (b->summary == NULL)
+    return false;
+  summarize (b);
+  return true;
 }
 
 /* Destroys bitmap B, freeing its storage.
@@ -124,6 +298,7 @@ bitmap_destroy (struct bitmap *b)
 {
   if (b != NULL)
     {
+      free (b->summary);
       free (b->bits);
       free (b);
     }
@@ -163,6 +338,7 @@ bitmap_mark (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the OR instruction in [IA32-v2b]. */
   asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
@@ -176,6 +352,7 @@ bitmap_reset (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the AND instruction in [IA32-v2a]. */
   asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -191,6 +368,7 @@ bitmap_flip (struct bitmap *b, size_t bit_idx)
      is guaranteed to be atomic on a uniprocessor machine.  See
      the description of the XOR instruction in [IA32-v2b]. */
   asm ("xorl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  update_summary (b, idx);
 }
 
 /* Returns the value of the bit numbered IDX in B. */
@@ -213,18 +391,37 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Returns a mask of the bits in the element that contains bit
+   START that lie between START and END, exclusive, and stores in
+   *NEXT the first bit after them, which is END or the first bit
+   of the next element. */
+static elem_type
+range_mask (size_t start, size_t end, size_t *next)
+{
+  size_t ofs = start % ELEM_BITS;
+  size_t n = ELEM_BITS - ofs < end - start ? ELEM_BITS - ofs : end - start;
+
+  *next = start + n;
+  return (n == ELEM_BITS ? (elem_type) -1
+          : (((elem_type) 1 << n) - 1) << ofs);
+}
+
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
+  size_t end = start + cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      set_elem (b, idx, range_mask (start, end, &start), value);
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -232,16 +429,21 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i, value_cnt;
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end)
+    {
+      size_t idx = elem_idx (start);
+      elem_type mask = range_mask (start, end, &start);
+      value_cnt += count_bits ((b->bits[idx] ^ flip) & mask);
+    }
   return value_cnt;
 }
 
@@ -250,16 +452,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
-  size_t i;
-
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return find_bit (b, start, start + cnt, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -291,20 +488,30 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
    VALUE.
-   If there is no such group, returns BITMAP_ERROR. */
+   If there is no such group, returns BITMAP_ERROR.
+   Each candidate group starts at a bit set to VALUE and either
+   succeeds or ends at a bit set to !VALUE, where the search
+   resumes, so the search takes time proportional to the number
+   of elements examined rather than bits times CNT. */
 size_t
 bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
 {
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
+  if (cnt == 0)
+    return start;
   if (cnt <= b->bit_cnt)
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i;
+      size_t i = start;
+      while ((i = find_bit (b, i, last + 1, value)) <= last)
+        {
+          size_t end = find_bit (b, i, i + cnt, !value);
+          if (end == i + cnt)
+            return i;
+          i = end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -346,6 +553,7 @@ bitmap_read (struct bitmap *b, struct file *file)
       off_t size = byte_cnt (b->bit_cnt);
       success = file_read_at (file, b->bits, size, 0) == size;
       b->bits[elem_cnt (b->bit_cnt) - 1] &= last_mask (b);
+      summarize (b);
     }
   return success;
 }
@@ -358,6 +566,23 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Writes the SIZE bytes of B's file image that start at byte
+   offset OFS, which must be within it, to the same offset in
+   FILE.  SIZE is trimmed to the end of the image.  Returns true
+   if successful, false otherwise. */
+bool
+bitmap_write_part (const struct bitmap *b, struct file *file,
+                   size_t ofs, size_t size)
+{
+  size_t file_size = byte_cnt (b->bit_cnt);
+
+  ASSERT (ofs <= file_size);
+  if (size > file_size - ofs)
+    size = file_size - ofs;
+  return (file_write_at (file, (const uint8_t *) b->bits + ofs, size, ofs)
+          == (off_t) size);
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -11,6 +11,7 @@
 struct bitmap *bitmap_create (size_t bit_cnt);
 struct bitmap *bitmap_create_in_buf (size_t bit_cnt, void *, size_t byte_cnt);
 size_t bitmap_buf_size (size_t bit_cnt);
+bool bitmap_enable_summary (struct bitmap *);
 void bitmap_destroy (struct bitmap *);
 
 /* Bitmap size. */
@@ -43,6 +44,8 @@ struct file;
 size_t bitmap_file_size (const struct bitmap *);
 bool bitmap_read (struct bitmap *, struct file *);
 bool bitmap_write (const struct bitmap *, struct file *);
+bool bitmap_write_part (const struct bitmap *, struct file *,
+                        size_t ofs, size_t size);
 #endif
 
 /* Debugging. */
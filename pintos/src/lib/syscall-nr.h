@@ -32,7 +32,11 @@ enum
     SYS_INUMBER,                /* Returns the inode number for a fd. */
 
     SYS_BLOCK_READS,            /* Returns block reads on fs_device. */
-    SYS_BLOCK_WRITES           /* Returns block writes on fs_device. */
+    SYS_BLOCK_WRITES,           /* Returns block writes on fs_device. */
+    SYS_CACHE_STATS,            /* Obtains buffer cache statistics. */
+    SYS_FSYNC,                  /* Writes a file's data to disk. */
+    SYS_SYNC,                   /* Writes all file data to disk. */
+    SYS_BLOCK_STATS             /* Obtains block device statistics. */
   };
 
 #endif /* lib/syscall-nr.h */
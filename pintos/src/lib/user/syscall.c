@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <syscall.h>
 #include "../syscall-nr.h"
+#include "../cache-stats.h"
+#include "../block-stats.h"
 
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
@@ -203,6 +205,40 @@ block_writes ()
   return syscall0 (SYS_BLOCK_WRITES);
 }
 
+/* Fills in STATS, which must be a struct cache_stats of the
+   layout described by <cache-stats.h>. */
+bool
+cache_stats (struct cache_stats *stats)
+{
+  stats->version = CACHE_STATS_VERSION;
+  stats->size = sizeof *stats;
+  return syscall1 (SYS_CACHE_STATS, stats);
+}
+
+void
+fsync (int fd)
+{
+  syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
+/* Fills in STATS, which must be a struct block_stats of the
+   layout described by <block-stats.h>, for the block device
+   named DEVICE, or for the file system device if DEVICE is
+   null.  Returns false if there is no such device. */
+bool
+block_stats (const char *device, struct block_stats *stats)
+{
+  stats->version = BLOCK_STATS_VERSION;
+  stats->size = sizeof *stats;
+  return syscall2 (SYS_BLOCK_STATS, device, stats);
+}
+
 void*
 sbrk (intptr_t increment)
 {
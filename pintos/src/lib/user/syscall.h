@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include <debug.h>
 
+struct cache_stats;
+struct block_stats;
+
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
@@ -49,6 +52,10 @@ int inumber (int fd);
 
 int block_reads (void);
 int block_writes (void);
+bool cache_stats (struct cache_stats *);
+void fsync (int fd);
+void sync (void);
+bool block_stats (const char *device, struct block_stats *);
 
 /* Homework 5, Part B. */
 void* sbrk (intptr_t increment);
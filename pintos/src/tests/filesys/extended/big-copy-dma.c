@@ -0,0 +1,3 @@
+/* Copies a large file with bus-master DMA where available. */
+
+#include "tests/filesys/extended/big-copy.inc"
@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(big-copy-dma) begin
+(big-copy-dma) create "src"
+(big-copy-dma) open "src"
+(big-copy-dma) write "src"
+(big-copy-dma) create "dst"
+(big-copy-dma) open "src"
+(big-copy-dma) open "dst"
+(big-copy-dma) copy "src" to "dst"
+(big-copy-dma) close "src"
+(big-copy-dma) close "dst"
+(big-copy-dma) open "dst" for verification
+(big-copy-dma) verified contents of "dst"
+(big-copy-dma) close "dst"
+(big-copy-dma) end
+EOF
+
+# Bulk reads land in kernel memory, so where the emulator offers
+# bus-master DMA, the copy's reads must use it.
+our ($test);
+my (@output) = read_text_file ("$test.output");
+my ($dma_reads) = 0;
+foreach (@output) {
+    $dma_reads += $1 if /^hd.: (\d+) sectors read and \d+ written by DMA/;
+}
+fail "no sectors read by DMA\n"
+  if grep (/^ide: bus-master DMA/, @output) && !$dma_reads;
+pass;
@@ -0,0 +1,3 @@
+/* Copies a large file on a file system formatted with extents. */
+
+#include "tests/filesys/extended/big-copy.inc"
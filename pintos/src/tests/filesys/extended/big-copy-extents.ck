@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(big-copy-extents) begin
+(big-copy-extents) create "src"
+(big-copy-extents) open "src"
+(big-copy-extents) write "src"
+(big-copy-extents) create "dst"
+(big-copy-extents) open "src"
+(big-copy-extents) open "dst"
+(big-copy-extents) copy "src" to "dst"
+(big-copy-extents) close "src"
+(big-copy-extents) close "dst"
+(big-copy-extents) open "dst" for verification
+(big-copy-extents) verified contents of "dst"
+(big-copy-extents) close "dst"
+(big-copy-extents) end
+EOF
+pass;
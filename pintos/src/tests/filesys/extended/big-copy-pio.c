@@ -0,0 +1,3 @@
+/* Copies a large file with PIO only. */
+
+#include "tests/filesys/extended/big-copy.inc"
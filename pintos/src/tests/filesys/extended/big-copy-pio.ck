@@ -0,0 +1,32 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(big-copy-pio) begin
+(big-copy-pio) create "src"
+(big-copy-pio) open "src"
+(big-copy-pio) write "src"
+(big-copy-pio) create "dst"
+(big-copy-pio) open "src"
+(big-copy-pio) open "dst"
+(big-copy-pio) copy "src" to "dst"
+(big-copy-pio) close "src"
+(big-copy-pio) close "dst"
+(big-copy-pio) open "dst" for verification
+(big-copy-pio) verified contents of "dst"
+(big-copy-pio) close "dst"
+(big-copy-pio) end
+EOF
+
+# With -no-dma, every transfer must use PIO.
+our ($test);
+my ($dma, $pio) = (0, 0);
+foreach (read_text_file ("$test.output")) {
+    next if !/^hd.: (\d+) sectors read and (\d+) written by DMA, (\d+) read and (\d+) written by PIO/;
+    $dma += $1 + $2;
+    $pio += $3 + $4;
+}
+fail "$dma sectors transferred by DMA despite -no-dma\n" if $dma;
+fail "no sectors transferred by PIO\n" if !$pio;
+pass;
@@ -0,0 +1,5 @@
+/* Copies a large file on a file system striped across a partition
+   of hdb and all of hdc, which are on different IDE channels.
+   Compare with big-copy-dma, which uses one disk. */
+
+#include "tests/filesys/extended/big-copy.inc"
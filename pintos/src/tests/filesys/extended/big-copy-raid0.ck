@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(big-copy-raid0) begin
+(big-copy-raid0) create "src"
+(big-copy-raid0) open "src"
+(big-copy-raid0) write "src"
+(big-copy-raid0) create "dst"
+(big-copy-raid0) open "src"
+(big-copy-raid0) open "dst"
+(big-copy-raid0) copy "src" to "dst"
+(big-copy-raid0) close "src"
+(big-copy-raid0) close "dst"
+(big-copy-raid0) open "dst" for verification
+(big-copy-raid0) verified contents of "dst"
+(big-copy-raid0) close "dst"
+(big-copy-raid0) end
+EOF
+pass;
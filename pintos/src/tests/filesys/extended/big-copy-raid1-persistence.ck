@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (512 * 512);
+check_archive ({"src" => [$data], "dst" => [$data]});
+pass;
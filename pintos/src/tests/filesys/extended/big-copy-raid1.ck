@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(big-copy-raid1) begin
+(big-copy-raid1) create "src"
+(big-copy-raid1) open "src"
+(big-copy-raid1) write "src"
+(big-copy-raid1) create "dst"
+(big-copy-raid1) open "src"
+(big-copy-raid1) open "dst"
+(big-copy-raid1) copy "src" to "dst"
+(big-copy-raid1) close "src"
+(big-copy-raid1) close "dst"
+(big-copy-raid1) open "dst" for verification
+(big-copy-raid1) verified contents of "dst"
+(big-copy-raid1) close "dst"
+(big-copy-raid1) end
+EOF
+pass;
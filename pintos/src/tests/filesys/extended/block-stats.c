@@ -0,0 +1,77 @@
+/* Writes and reads back a file, and checks that the file system
+   device's statistics from block_stats() add up. */
+
+#include <block-stats.h>
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (16 * 512)
+
+static char buf[FILE_SIZE];
+
+/* Returns the number of requests in HISTOGRAM. */
+static uint64_t
+histogram_total (const uint64_t histogram[BLOCK_STATS_BUCKETS])
+{
+  uint64_t total = 0;
+  int i;
+
+  for (i = 0; i < BLOCK_STATS_BUCKETS; i++)
+    total += histogram[i];
+  return total;
+}
+
+void
+test_main (void)
+{
+  struct block_stats before, after, s;
+  uint64_t completed;
+  int fd;
+
+  CHECK (block_stats (NULL, &before), "get file system device statistics");
+  if (before.version != BLOCK_STATS_VERSION || before.size != sizeof before)
+    fail ("version %u, size %u, expected %u, %zu", before.version,
+          before.size, BLOCK_STATS_VERSION, sizeof before);
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf, "write \"data\"");
+  msg ("fsync \"data\"");
+  fsync (fd);
+  msg ("close \"data\"");
+  close (fd);
+
+  CHECK (block_stats (NULL, &after), "get file system device statistics");
+  if (after.write_requests <= before.write_requests)
+    fail ("no write requests counted");
+  if (histogram_total (after.write_latency)
+      <= histogram_total (before.write_latency))
+    fail ("no write latencies counted");
+
+  /* Requests still outstanding are counted as submitted but not
+     yet completed. */
+  completed = (histogram_total (after.read_latency)
+               + histogram_total (after.write_latency));
+  if (completed > after.read_requests + after.write_requests)
+    fail ("%llu requests completed but only %llu submitted", completed,
+          after.read_requests + after.write_requests);
+  if (after.busy_cycles == 0 || after.busy_cycles > after.elapsed_cycles)
+    fail ("busy for %llu of %llu cycles", after.busy_cycles,
+          after.elapsed_cycles);
+  if (after.depth_cycles < after.busy_cycles)
+    fail ("queue depth below 1 while busy");
+  if (after.latency_cycles < completed)
+    fail ("total latency %llu cycles for %llu requests",
+          after.latency_cycles, completed);
+
+  CHECK (block_stats (after.name, &s), "get its statistics by name");
+  if (s.writes < after.writes)
+    fail ("statistics went backward");
+  CHECK (!block_stats ("no-such-disk", &s),
+         "get statistics for nonexistent device (must fail)");
+
+  check_file ("data", buf, sizeof buf);
+}
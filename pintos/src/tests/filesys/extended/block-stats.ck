@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(block-stats) begin
+(block-stats) get file system device statistics
+(block-stats) create "data"
+(block-stats) open "data"
+(block-stats) write "data"
+(block-stats) fsync "data"
+(block-stats) close "data"
+(block-stats) get file system device statistics
+(block-stats) get its statistics by name
+(block-stats) get statistics for nonexistent device (must fail)
+(block-stats) open "data" for verification
+(block-stats) verified contents of "data"
+(block-stats) close "data"
+(block-stats) end
+EOF
+pass;
@@ -0,0 +1,9 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my (%files) = ("big" => [random_bytes (40 * 512 * 16)]);
+$files{"small$_"} = [random_bytes (300)] foreach 0...7;
+check_archive (\%files);
+pass;
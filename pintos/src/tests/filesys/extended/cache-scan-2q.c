@@ -0,0 +1,4 @@
+/* Streams a large file between small file reads with the
+   2Q replacement policy. */
+
+#include "tests/filesys/extended/cache-scan.inc"
@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-scan-2q) begin
+(cache-scan-2q) create "big"
+(cache-scan-2q) open "big"
+(cache-scan-2q) write "big"
+(cache-scan-2q) create "small0"
+(cache-scan-2q) open "small0"
+(cache-scan-2q) write "small0"
+(cache-scan-2q) create "small1"
+(cache-scan-2q) open "small1"
+(cache-scan-2q) write "small1"
+(cache-scan-2q) create "small2"
+(cache-scan-2q) open "small2"
+(cache-scan-2q) write "small2"
+(cache-scan-2q) create "small3"
+(cache-scan-2q) open "small3"
+(cache-scan-2q) write "small3"
+(cache-scan-2q) create "small4"
+(cache-scan-2q) open "small4"
+(cache-scan-2q) write "small4"
+(cache-scan-2q) create "small5"
+(cache-scan-2q) open "small5"
+(cache-scan-2q) write "small5"
+(cache-scan-2q) create "small6"
+(cache-scan-2q) open "small6"
+(cache-scan-2q) write "small6"
+(cache-scan-2q) create "small7"
+(cache-scan-2q) open "small7"
+(cache-scan-2q) write "small7"
+(cache-scan-2q) stream "big" between small file reads
+(cache-scan-2q) end
+EOF
+pass;
@@ -0,0 +1,37 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cache-scan-lru) begin
+(cache-scan-lru) create "big"
+(cache-scan-lru) open "big"
+(cache-scan-lru) write "big"
+(cache-scan-lru) create "small0"
+(cache-scan-lru) open "small0"
+(cache-scan-lru) write "small0"
+(cache-scan-lru) create "small1"
+(cache-scan-lru) open "small1"
+(cache-scan-lru) write "small1"
+(cache-scan-lru) create "small2"
+(cache-scan-lru) open "small2"
+(cache-scan-lru) write "small2"
+(cache-scan-lru) create "small3"
+(cache-scan-lru) open "small3"
+(cache-scan-lru) write "small3"
+(cache-scan-lru) create "small4"
+(cache-scan-lru) open "small4"
+(cache-scan-lru) write "small4"
+(cache-scan-lru) create "small5"
+(cache-scan-lru) open "small5"
+(cache-scan-lru) write "small5"
+(cache-scan-lru) create "small6"
+(cache-scan-lru) open "small6"
+(cache-scan-lru) write "small6"
+(cache-scan-lru) create "small7"
+(cache-scan-lru) open "small7"
+(cache-scan-lru) write "small7"
+(cache-scan-lru) stream "big" between small file reads
+(cache-scan-lru) end
+EOF
+pass;
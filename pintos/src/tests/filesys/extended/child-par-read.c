@@ -0,0 +1,46 @@
+/* Child process for the par-read tests.
+   Reads every slice of the file whose index is congruent to our
+   own index modulo the number of readers, and checks it against
+   the data that our parent wrote. */
+
+#include <random.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/par-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-par-read";
+
+static char expected[BUF_SIZE];
+static char actual[SLICE_SIZE];
+
+int
+main (int argc, const char *argv[])
+{
+  int child_idx, child_cnt;
+  int slice;
+  int fd;
+
+  quiet = true;
+
+  CHECK (argc == 3, "argc must be 3, actually %d", argc);
+  child_idx = atoi (argv[1]);
+  child_cnt = atoi (argv[2]);
+
+  random_init (0);
+  random_bytes (expected, sizeof expected);
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (slice = child_idx; slice < SLICE_CNT; slice += child_cnt)
+    {
+      size_t ofs = slice * SLICE_SIZE;
+      seek (fd, ofs);
+      CHECK (read (fd, actual, SLICE_SIZE) == SLICE_SIZE,
+             "read %d bytes at offset %zu in \"%s\"",
+             SLICE_SIZE, ofs, file_name);
+      compare_bytes (actual, expected + ofs, SLICE_SIZE, ofs, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
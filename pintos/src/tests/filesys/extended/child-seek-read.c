@@ -0,0 +1,48 @@
+/* Child process for the seek-read tests.
+   Reads the file whose index is given on the command line one
+   sector at a time, in the order described in seek-read.h, and
+   checks it against the data that our parent wrote. */
+
+#include <random.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/filesys/extended/seek-read.h"
+#include "tests/lib.h"
+
+const char *test_name = "child-seek-read";
+
+static char expected[FILE_SIZE];
+static char actual[512];
+
+int
+main (int argc, const char *argv[])
+{
+  char file_name[16];
+  int child_idx;
+  int i;
+  int fd;
+
+  quiet = true;
+
+  CHECK (argc == 2, "argc must be 2, actually %d", argc);
+  child_idx = atoi (argv[1]);
+
+  random_init (0);
+  random_bytes (expected, sizeof expected);
+
+  snprintf (file_name, sizeof file_name, "seek%d", child_idx);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  for (i = 0; i < SECTOR_CNT; i++)
+    {
+      size_t ofs = (size_t) (i * STRIDE % SECTOR_CNT) * sizeof actual;
+      seek (fd, ofs);
+      CHECK (read (fd, actual, sizeof actual) == sizeof actual,
+             "read %zu bytes at offset %zu in \"%s\"",
+             sizeof actual, ofs, file_name);
+      compare_bytes (actual, expected + ofs, sizeof actual, ofs, file_name);
+    }
+  close (fd);
+
+  return child_idx;
+}
@@ -0,0 +1,4 @@
+/* Writes a large file sequentially, writing back dirty
+   sectors one at a time. */
+
+#include "tests/filesys/extended/cluster-write.inc"
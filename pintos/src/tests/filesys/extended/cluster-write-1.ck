@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cluster-write-1) begin
+(cluster-write-1) create "big"
+(cluster-write-1) open "big"
+(cluster-write-1) write "big" in 1024-byte chunks
+(cluster-write-1) close "big"
+(cluster-write-1) open "big" for verification
+(cluster-write-1) verified contents of "big"
+(cluster-write-1) close "big"
+(cluster-write-1) end
+EOF
+pass;
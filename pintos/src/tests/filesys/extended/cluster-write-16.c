@@ -0,0 +1,4 @@
+/* Writes a large file sequentially, writing back dirty
+   sectors in runs of up to 16. */
+
+#include "tests/filesys/extended/cluster-write.inc"
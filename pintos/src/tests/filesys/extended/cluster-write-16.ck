@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(cluster-write-16) begin
+(cluster-write-16) create "big"
+(cluster-write-16) open "big"
+(cluster-write-16) write "big" in 1024-byte chunks
+(cluster-write-16) close "big"
+(cluster-write-16) open "big" for verification
+(cluster-write-16) verified contents of "big"
+(cluster-write-16) close "big"
+(cluster-write-16) end
+EOF
+pass;
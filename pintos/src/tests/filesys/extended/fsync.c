@@ -0,0 +1,46 @@
+/* Writes a file with the flusher thread disabled, then checks
+   that fsync writes its sectors back and that a second fsync,
+   with nothing left to write, writes nothing. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (8 * 512)
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+  int writes;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == (int) sizeof buf, "write \"data\"");
+
+  msg ("fsync \"data\"");
+  writes = block_writes ();
+  fsync (fd);
+  writes = block_writes () - writes;
+  if (writes < FILE_SIZE / 512)
+    fail ("fsync wrote %d sectors, expected at least %d",
+          writes, FILE_SIZE / 512);
+
+  msg ("fsync \"data\" again");
+  writes = block_writes ();
+  fsync (fd);
+  writes = block_writes () - writes;
+  if (writes != 0)
+    fail ("second fsync wrote %d sectors, expected none", writes);
+
+  msg ("sync");
+  sync ();
+  msg ("close \"data\"");
+  close (fd);
+
+  check_file ("data", buf, sizeof buf);
+}
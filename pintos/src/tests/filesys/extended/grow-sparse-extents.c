@@ -0,0 +1,4 @@
+/* Makes a large sparse file on a file system formatted with
+   extents. */
+
+#include "tests/filesys/extended/grow-sparse-lg.inc"
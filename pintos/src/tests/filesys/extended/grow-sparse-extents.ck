@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-extents) begin
+(grow-sparse-extents) get file system device statistics
+(grow-sparse-extents) create "sparse"
+(grow-sparse-extents) open "sparse"
+(grow-sparse-extents) seek "sparse"
+(grow-sparse-extents) write "sparse"
+(grow-sparse-extents) fsync "sparse"
+(grow-sparse-extents) get file system device statistics
+(grow-sparse-extents) read "sparse"
+(grow-sparse-extents) close "sparse"
+(grow-sparse-extents) remove "sparse"
+(grow-sparse-extents) end
+EOF
+pass;
@@ -0,0 +1,3 @@
+/* Makes a large sparse file, with a block map. */
+
+#include "tests/filesys/extended/grow-sparse-lg.inc"
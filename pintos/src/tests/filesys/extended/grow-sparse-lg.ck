@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(grow-sparse-lg) begin
+(grow-sparse-lg) get file system device statistics
+(grow-sparse-lg) create "sparse"
+(grow-sparse-lg) open "sparse"
+(grow-sparse-lg) seek "sparse"
+(grow-sparse-lg) write "sparse"
+(grow-sparse-lg) fsync "sparse"
+(grow-sparse-lg) get file system device statistics
+(grow-sparse-lg) read "sparse"
+(grow-sparse-lg) close "sparse"
+(grow-sparse-lg) remove "sparse"
+(grow-sparse-lg) end
+EOF
+pass;
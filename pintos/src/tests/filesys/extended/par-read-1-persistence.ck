@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+check_archive ({"child-par-read" => "tests/filesys/extended/child-par-read",
+		"bigfile" => [random_bytes (4 * 64 * 512)]});
+pass;
@@ -0,0 +1,6 @@
+/* Reads back a file four times the size of the buffer cache
+   with a single reader process, each taking an equal share of
+   the file's sectors. */
+
+#define READER_CNT 1
+#include "tests/filesys/extended/par-read.inc"
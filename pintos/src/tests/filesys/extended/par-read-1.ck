@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-read-1) begin
+(par-read-1) create "bigfile"
+(par-read-1) open "bigfile"
+(par-read-1) write "bigfile"
+(par-read-1) close "bigfile"
+(par-read-1) exec child 1 of 1: "child-par-read 0 1"
+(par-read-1) wait for child 1 of 1 returned 0 (expected 0)
+(par-read-1) end
+EOF
+pass;
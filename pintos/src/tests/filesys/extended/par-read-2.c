@@ -0,0 +1,6 @@
+/* Reads back a file four times the size of the buffer cache
+   with two reader processes, each taking an equal share of
+   the file's sectors. */
+
+#define READER_CNT 2
+#include "tests/filesys/extended/par-read.inc"
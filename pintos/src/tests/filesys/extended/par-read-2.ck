@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-read-2) begin
+(par-read-2) create "bigfile"
+(par-read-2) open "bigfile"
+(par-read-2) write "bigfile"
+(par-read-2) close "bigfile"
+(par-read-2) exec child 1 of 2: "child-par-read 0 2"
+(par-read-2) exec child 2 of 2: "child-par-read 1 2"
+(par-read-2) wait for child 1 of 2 returned 0 (expected 0)
+(par-read-2) wait for child 2 of 2 returned 1 (expected 1)
+(par-read-2) end
+EOF
+pass;
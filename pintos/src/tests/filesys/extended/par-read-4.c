@@ -0,0 +1,6 @@
+/* Reads back a file four times the size of the buffer cache
+   with four reader processes, each taking an equal share of
+   the file's sectors. */
+
+#define READER_CNT 4
+#include "tests/filesys/extended/par-read.inc"
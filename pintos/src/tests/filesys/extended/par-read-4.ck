@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(par-read-4) begin
+(par-read-4) create "bigfile"
+(par-read-4) open "bigfile"
+(par-read-4) write "bigfile"
+(par-read-4) close "bigfile"
+(par-read-4) exec child 1 of 4: "child-par-read 0 4"
+(par-read-4) exec child 2 of 4: "child-par-read 1 4"
+(par-read-4) exec child 3 of 4: "child-par-read 2 4"
+(par-read-4) exec child 4 of 4: "child-par-read 3 4"
+(par-read-4) wait for child 1 of 4 returned 0 (expected 0)
+(par-read-4) wait for child 2 of 4 returned 1 (expected 1)
+(par-read-4) wait for child 3 of 4 returned 2 (expected 2)
+(par-read-4) wait for child 4 of 4 returned 3 (expected 3)
+(par-read-4) end
+EOF
+pass;
@@ -0,0 +1,12 @@
+#ifndef TESTS_FILESYS_EXTENDED_PAR_READ_H
+#define TESTS_FILESYS_EXTENDED_PAR_READ_H
+
+/* The file is four times the size of the buffer cache, so that
+   readers miss and must wait on the disk.  It is split into
+   SLICE_CNT slices that the readers divide among themselves. */
+#define SLICE_SIZE (64 * 512)
+#define SLICE_CNT 4
+#define BUF_SIZE (SLICE_SIZE * SLICE_CNT)
+static const char file_name[] = "bigfile";
+
+#endif /* tests/filesys/extended/par-read.h */
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(seek-read-cscan) begin
+(seek-read-cscan) create "seek0"
+(seek-read-cscan) open "seek0"
+(seek-read-cscan) write "seek0"
+(seek-read-cscan) close "seek0"
+(seek-read-cscan) create "seek1"
+(seek-read-cscan) open "seek1"
+(seek-read-cscan) write "seek1"
+(seek-read-cscan) close "seek1"
+(seek-read-cscan) create "seek2"
+(seek-read-cscan) open "seek2"
+(seek-read-cscan) write "seek2"
+(seek-read-cscan) close "seek2"
+(seek-read-cscan) create "seek3"
+(seek-read-cscan) open "seek3"
+(seek-read-cscan) write "seek3"
+(seek-read-cscan) close "seek3"
+(seek-read-cscan) exec child 1 of 4: "child-seek-read 0"
+(seek-read-cscan) exec child 2 of 4: "child-seek-read 1"
+(seek-read-cscan) exec child 3 of 4: "child-seek-read 2"
+(seek-read-cscan) exec child 4 of 4: "child-seek-read 3"
+(seek-read-cscan) wait for child 1 of 4 returned 0 (expected 0)
+(seek-read-cscan) wait for child 2 of 4 returned 1 (expected 1)
+(seek-read-cscan) wait for child 3 of 4 returned 2 (expected 2)
+(seek-read-cscan) wait for child 4 of 4 returned 3 (expected 3)
+(seek-read-cscan) end
+EOF
+pass;
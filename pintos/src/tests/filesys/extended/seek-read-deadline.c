@@ -0,0 +1,4 @@
+/* Reads back four files, one per reader process, each jumping
+   around its own file, with the deadline I/O scheduler. */
+
+#include "tests/filesys/extended/seek-read.inc"
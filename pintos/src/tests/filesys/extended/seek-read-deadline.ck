@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(seek-read-deadline) begin
+(seek-read-deadline) create "seek0"
+(seek-read-deadline) open "seek0"
+(seek-read-deadline) write "seek0"
+(seek-read-deadline) close "seek0"
+(seek-read-deadline) create "seek1"
+(seek-read-deadline) open "seek1"
+(seek-read-deadline) write "seek1"
+(seek-read-deadline) close "seek1"
+(seek-read-deadline) create "seek2"
+(seek-read-deadline) open "seek2"
+(seek-read-deadline) write "seek2"
+(seek-read-deadline) close "seek2"
+(seek-read-deadline) create "seek3"
+(seek-read-deadline) open "seek3"
+(seek-read-deadline) write "seek3"
+(seek-read-deadline) close "seek3"
+(seek-read-deadline) exec child 1 of 4: "child-seek-read 0"
+(seek-read-deadline) exec child 2 of 4: "child-seek-read 1"
+(seek-read-deadline) exec child 3 of 4: "child-seek-read 2"
+(seek-read-deadline) exec child 4 of 4: "child-seek-read 3"
+(seek-read-deadline) wait for child 1 of 4 returned 0 (expected 0)
+(seek-read-deadline) wait for child 2 of 4 returned 1 (expected 1)
+(seek-read-deadline) wait for child 3 of 4 returned 2 (expected 2)
+(seek-read-deadline) wait for child 4 of 4 returned 3 (expected 3)
+(seek-read-deadline) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($data) = random_bytes (64 * 512);
+check_archive ({"child-seek-read" => "tests/filesys/extended/child-seek-read",
+		"seek0" => [$data], "seek1" => [$data],
+		"seek2" => [$data], "seek3" => [$data]});
+pass;
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(seek-read-fifo) begin
+(seek-read-fifo) create "seek0"
+(seek-read-fifo) open "seek0"
+(seek-read-fifo) write "seek0"
+(seek-read-fifo) close "seek0"
+(seek-read-fifo) create "seek1"
+(seek-read-fifo) open "seek1"
+(seek-read-fifo) write "seek1"
+(seek-read-fifo) close "seek1"
+(seek-read-fifo) create "seek2"
+(seek-read-fifo) open "seek2"
+(seek-read-fifo) write "seek2"
+(seek-read-fifo) close "seek2"
+(seek-read-fifo) create "seek3"
+(seek-read-fifo) open "seek3"
+(seek-read-fifo) write "seek3"
+(seek-read-fifo) close "seek3"
+(seek-read-fifo) exec child 1 of 4: "child-seek-read 0"
+(seek-read-fifo) exec child 2 of 4: "child-seek-read 1"
+(seek-read-fifo) exec child 3 of 4: "child-seek-read 2"
+(seek-read-fifo) exec child 4 of 4: "child-seek-read 3"
+(seek-read-fifo) wait for child 1 of 4 returned 0 (expected 0)
+(seek-read-fifo) wait for child 2 of 4 returned 1 (expected 1)
+(seek-read-fifo) wait for child 3 of 4 returned 2 (expected 2)
+(seek-read-fifo) wait for child 4 of 4 returned 3 (expected 3)
+(seek-read-fifo) end
+EOF
+pass;
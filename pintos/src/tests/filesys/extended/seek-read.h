@@ -0,0 +1,18 @@
+#ifndef TESTS_FILESYS_EXTENDED_SEEK_READ_H
+#define TESTS_FILESYS_EXTENDED_SEEK_READ_H
+
+/* FILE_CNT files, together four times the size of the buffer
+   cache, one per reader.  Each reader visits the sectors of its
+   own file in an order that defeats read-ahead, so that every
+   read goes to the disk and the disk head has to move between
+   the files. */
+#define FILE_CNT 4
+#define SECTOR_CNT 64
+#define FILE_SIZE (SECTOR_CNT * 512)
+
+/* Readers visit sector I * STRIDE % SECTOR_CNT on their Ith
+   read.  STRIDE must have no factor in common with
+   SECTOR_CNT. */
+#define STRIDE 23
+
+#endif /* tests/filesys/extended/seek-read.h */
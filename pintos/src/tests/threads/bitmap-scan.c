@@ -0,0 +1,145 @@
+/* Checks bitmap_scan() against a bit-at-a-time search on large
+   bitmaps that are empty, fragmented, and nearly full, then
+   reports how many cycles a search for free bits takes in each,
+   the way the free map and the page allocator search, with and
+   without a summary. */
+
+#include <bitmap.h>
+#include <inttypes.h>
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+/* Bits per bitmap: a 32 MB disk's worth of sectors. */
+#define BIT_CNT 65536
+
+/* Searches timed per measurement. */
+#define SCAN_CNT 16
+
+enum fill
+  {
+    EMPTY,              /* All bits free. */
+    FRAGMENTED,         /* One bit in four free, at random. */
+    NEARLY_FULL         /* A free bit every 4096, then 64 at the end. */
+  };
+
+static const char *fill_names[] = {"empty", "fragmented", "nearly full"};
+
+/* Sets the bits of B according to FILL. */
+static void
+fill_bitmap (struct bitmap *b, enum fill fill)
+{
+  size_t i;
+
+  switch (fill)
+    {
+    case EMPTY:
+      bitmap_set_all (b, false);
+      break;
+
+    case FRAGMENTED:
+      random_init (0);
+      for (i = 0; i < BIT_CNT; i++)
+        bitmap_set (b, i, random_ulong () % 4 != 0);
+      break;
+
+    case NEARLY_FULL:
+      bitmap_set_all (b, true);
+      for (i = 4095; i < BIT_CNT; i += 4096)
+        bitmap_reset (b, i);
+      bitmap_set_multiple (b, BIT_CNT - 64, 64, false);
+      break;
+    }
+}
+
+/* Returns what bitmap_scan (B, START, CNT, VALUE) should,
+   testing one bit at a time, the way bitmap_scan() used to. */
+static size_t
+slow_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  size_t i, j;
+
+  for (i = start; i + cnt <= bitmap_size (b); i++)
+    {
+      for (j = 0; j < cnt; j++)
+        if (bitmap_test (b, i + j) != value)
+          break;
+      if (j == cnt)
+        return i;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Checks bitmap_scan() on B, filled according to FILL. */
+static void
+check_scans (const struct bitmap *b, enum fill fill)
+{
+  static const size_t counts[] = {1, 8, 64, 65};
+  static const size_t starts[] = {0, 1, 31, 32, BIT_CNT / 2, BIT_CNT - 64};
+  size_t i, j;
+  int value;
+
+  for (i = 0; i < sizeof counts / sizeof *counts; i++)
+    for (j = 0; j < sizeof starts / sizeof *starts; j++)
+      for (value = 0; value <= 1; value++)
+        {
+          size_t expected = slow_scan (b, starts[j], counts[i], value);
+          size_t actual = bitmap_scan (b, starts[j], counts[i], value);
+          if (actual != expected)
+            fail ("%s: scan from %zu for %zu %s bits found %zu, "
+                  "expected %zu", fill_names[fill], starts[j], counts[i],
+                  value ? "true" : "false", actual, expected);
+        }
+}
+
+/* Returns the average number of cycles SCAN takes to search B
+   for CNT free bits, or SLOW_SCAN if SLOW is true. */
+static uint64_t
+time_scans (const struct bitmap *b, size_t cnt, bool slow)
+{
+  uint64_t start = timer_cycles ();
+  int i;
+
+  for (i = 0; i < SCAN_CNT; i++)
+    if (slow)
+      slow_scan (b, 0, cnt, false);
+    else
+      bitmap_scan (b, 0, cnt, false);
+  return (timer_cycles () - start) / SCAN_CNT;
+}
+
+void
+test_bitmap_scan (void)
+{
+  struct bitmap *plain = bitmap_create (BIT_CNT);
+  struct bitmap *summarized = bitmap_create (BIT_CNT);
+  enum fill fill;
+
+  if (plain == NULL || summarized == NULL
+      || !bitmap_enable_summary (summarized))
+    fail ("out of memory");
+
+  for (fill = EMPTY; fill <= NEARLY_FULL; fill++)
+    {
+      static const size_t counts[] = {1, 8};
+      size_t i;
+
+      fill_bitmap (plain, fill);
+      fill_bitmap (summarized, fill);
+      check_scans (plain, fill);
+      check_scans (summarized, fill);
+
+      for (i = 0; i < sizeof counts / sizeof *counts; i++)
+        msg ("%s, %zu free: %"PRIu64" cycles bit by bit, "
+             "%"PRIu64" by word, %"PRIu64" with summary",
+             fill_names[fill], counts[i],
+             time_scans (plain, counts[i], true),
+             time_scans (plain, counts[i], false),
+             time_scans (summarized, counts[i], false));
+    }
+
+  bitmap_destroy (plain);
+  bitmap_destroy (summarized);
+  pass ();
+}
@@ -34,8 +34,14 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/raid.h"
+#include "devices/ramdisk.h"
+#include "devices/block-trace.h"
+#include "devices/virtio.h"
+#include "filesys/cache.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
 #endif
 
 /* Page directory with kernel mappings only. */
@@ -52,6 +58,21 @@ static const char *scratch_bdev_name;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
+
+/* -raid0, -raid1: RAID level and comma-separated member block
+   devices of an array to create as md0, if any. */
+static int raid_level;
+static char *raid_members;
+
+/* -ramdisk, -ramdisk-load: Size in sectors of a RAM disk to
+   create as ram0, if nonzero, and whether to copy the scratch
+   device into it. */
+static block_sector_t ramdisk_size;
+static bool ramdisk_load;
+
+/* -trace: Number of block requests to keep in the I/O trace, or
+   0 not to trace. */
+static size_t trace_entries;
 #endif /* FILESYS */
 
 /* -ul: Maximum number of pages to put into palloc's user pool. */
@@ -77,9 +98,12 @@ int
 main (void)
 {
   char **argv;
+  uint64_t boot_cycles;
 
-  /* Clear BSS. */
+  /* Clear BSS, then note how long the loader took to get us
+     here.  The TSC starts counting at reset. */
   bss_init ();
+  boot_cycles = timer_cycles ();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
@@ -93,6 +117,8 @@ main (void)
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
+  printf ("Boot: %'"PRIu64" cycles from reset to kernel entry.\n",
+          boot_cycles);
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
@@ -122,8 +148,21 @@ main (void)
 
 #ifdef FILESYS
   /* Initialize file system. */
+  if (trace_entries > 0)
+    block_trace_init (trace_entries);
   ide_init ();
+  virtio_blk_init ();
+  if (ramdisk_size > 0)
+    ramdisk_create (ramdisk_size);
+  if (raid_members != NULL)
+    raid_create (raid_level, raid_members);
   locate_block_devices ();
+  if (ramdisk_load)
+    {
+      if (ramdisk_size == 0 || block_get_role (BLOCK_SCRATCH) == NULL)
+        PANIC ("-ramdisk-load requires -ramdisk and a scratch device");
+      ramdisk_preload (block_get_role (BLOCK_SCRATCH));
+    }
   filesys_init (format_filesys);
 #endif
 
@@ -243,10 +282,47 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-extents"))
+        inode_use_extents = true;
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-raid0") || !strcmp (name, "-raid1"))
+        {
+          if (value == NULL)
+            PANIC ("%s requires a list of block devices", name);
+          raid_level = name[5] - '0';
+          raid_members = value;
+        }
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_size = atoi (value);
+      else if (!strcmp (name, "-ramdisk-load"))
+        ramdisk_load = true;
+      else if (!strcmp (name, "-trace"))
+        trace_entries = atoi (value);
+      else if (!strcmp (name, "-no-dma"))
+        ide_use_dma = false;
+      else if (!strcmp (name, "-io-sched"))
+        {
+          if (!block_set_scheduler (value))
+            PANIC ("unknown I/O scheduler `%s'", value);
+        }
+      else if (!strcmp (name, "-ra-max"))
+        cache_readahead_max = atoi (value);
+      else if (!strcmp (name, "-flush-ticks"))
+        cache_flush_interval = atoi (value);
+      else if (!strcmp (name, "-cluster"))
+        cache_cluster_max = atoi (value);
+      else if (!strcmp (name, "-cache-size"))
+        cache_size = atoi (value);
+      else if (!strcmp (name, "-cache-pct"))
+        cache_pct = atoi (value);
+      else if (!strcmp (name, "-cache-policy"))
+        {
+          if (!cache_set_policy (value))
+            PANIC ("unknown cache policy `%s'", value);
+        }
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -371,8 +447,22 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -extents           With -f, map file data with extents.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -raid0=BDEV,BDEV.. Create md0 striped across the BDEVs.\n"
+          "  -raid1=BDEV,BDEV.. Create md0 mirrored across the BDEVs.\n"
+          "  -ramdisk=SECTORS   Create RAM disk ram0 of SECTORS sectors.\n"
+          "  -ramdisk-load      Copy the scratch device into ram0 at boot.\n"
+          "  -trace=N           Trace last N block requests to scratch at exit.\n"
+          "  -no-dma            Use PIO instead of DMA for IDE disks.\n"
+          "  -io-sched=NAME     Use I/O scheduler NAME (fifo, cscan, deadline).\n"
+          "  -ra-max=SECTORS    Limit read-ahead window to SECTORS (0=off).\n"
+          "  -flush-ticks=N     Write back dirty cache blocks every N ticks (0=off).\n"
+          "  -cache-policy=NAME Use buffer cache replacement policy NAME (lru, 2q).\n"
+          "  -cluster=N         Write back up to N adjacent dirty sectors at once.\n"
+          "  -cache-size=N      Size buffer cache to N sectors (default 64).\n"
+          "  -cache-pct=PCT     Size buffer cache to PCT%% of the kernel pool.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -36,6 +36,9 @@ struct pool
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Called when the kernel pool is exhausted. */
+static palloc_reclaim_func *reclaim_hook;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
@@ -61,12 +64,30 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
+/* Sets HOOK to be called when the kernel pool runs out of
+   pages, so that a subsystem holding pages it can do without,
+   such as the buffer cache, can give some back. */
+void
+palloc_set_reclaim_hook (palloc_reclaim_func *hook)
+{
+  reclaim_hook = hook;
+}
+
+/* Returns the number of pages in the kernel pool. */
+size_t
+palloc_kernel_page_cnt (void)
+{
+  return bitmap_size (kernel_pool.used_map);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   available in the kernel pool, asks the reclaim hook, if any,
+   to free some and tries again.  If that does not help, returns
+   a null pointer, unless PAL_ASSERT is set in FLAGS, in which
+   case the kernel panics. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
@@ -77,9 +98,16 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  for (;;)
+    {
+      lock_acquire (&pool->lock);
+      page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+      lock_release (&pool->lock);
+
+      if (page_idx != BITMAP_ERROR || pool != &kernel_pool
+          || reclaim_hook == NULL || !reclaim_hook (page_cnt))
+        break;
+    }
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,7 +12,13 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* Called when the kernel pool runs out of pages, to free up to
+   PAGE_CNT pages.  Returns true if it freed any. */
+typedef bool palloc_reclaim_func (size_t page_cnt);
+
 void palloc_init (size_t user_page_limit);
+void palloc_set_reclaim_hook (palloc_reclaim_func *);
+size_t palloc_kernel_page_cnt (void);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
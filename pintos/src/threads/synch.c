@@ -336,3 +336,97 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW.  A readers-writer lock may be held by any
+   number of readers at once or by a single writer, but not by
+   both.  Waiting writers take precedence over new readers, so a
+   steady stream of readers cannot starve a writer.
+
+   Like a lock, a readers-writer lock is not recursive: a thread
+   that holds RW in either mode must not try to acquire it
+   again. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writer_ok);
+  rw->reader_cnt = 0;
+  rw->writer_wait_cnt = 0;
+  rw->writer = NULL;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or is
+   waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  while (rw->writer != NULL || rw->writer_wait_cnt > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for
+   reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->writer_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it in either mode. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rw->writer != thread_current ());
+
+  lock_acquire (&rw->lock);
+  rw->writer_wait_cnt++;
+  while (rw->writer != NULL || rw->reader_cnt > 0)
+    cond_wait (&rw->writer_ok, &rw->lock);
+  rw->writer_wait_cnt--;
+  rw->writer = thread_current ();
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread must hold for
+   writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->writer == thread_current ());
+  rw->writer = NULL;
+  if (rw->writer_wait_cnt > 0)
+    cond_signal (&rw->writer_ok, &rw->lock);
+  else
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
@@ -1,6 +1,8 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
 #include <syscall-nr.h>
+#include <cache-stats.h>
+#include <block-stats.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "devices/shutdown.h"
@@ -10,6 +12,9 @@
 #include "lib/string.h"
 #include "threads/synch.h"
 #include "filesys/filesys.h"
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "filesys/free-map.h"
 
 static void syscall_handler (struct intr_frame *);
 static void fault_terminate (struct intr_frame *);
@@ -368,6 +373,66 @@ syscall_handler (struct intr_frame *f UNUSED)
     {
       f->eax = get_block_writes (BLOCK_FILESYS);
     }
+  else if (args[0] == SYS_CACHE_STATS)
+    {
+      if (!is_valid_addr (args, 2 * sizeof (uint32_t))
+          || !is_valid_addr ((void *) args[1], 2 * sizeof (uint32_t)))
+        {
+          fault_terminate (f);
+        }
+      struct cache_stats *stats = (struct cache_stats *) args[1];
+      if (!is_valid_addr (stats, stats->size))
+        fault_terminate (f);
+      if (stats->size < 2 * sizeof (uint32_t))
+        f->eax = false;
+      else
+        {
+          cache_get_stats (stats);
+          f->eax = true;
+        }
+    }
+  else if (args[0] == SYS_FSYNC)
+    {
+      if (!is_valid_addr (args, 2 * sizeof (uint32_t)))
+        {
+          fault_terminate (f);
+        }
+
+      int fd = args[1];
+      struct thread_file *tf = get_thread_file (fd);
+      if (tf == NULL)
+        {
+          fault_terminate (f);
+        }
+      file_sync (tf->file);
+      free_map_sync ();
+    }
+  else if (args[0] == SYS_SYNC)
+    {
+      filesys_sync ();
+    }
+  else if (args[0] == SYS_BLOCK_STATS)
+    {
+      if (!is_valid_addr (args, 3 * sizeof (uint32_t))
+          || (args[1] != 0 && !is_valid_str ((char *) args[1]))
+          || !is_valid_addr ((void *) args[2], 2 * sizeof (uint32_t)))
+        {
+          fault_terminate (f);
+        }
+      struct block_stats *stats = (struct block_stats *) args[2];
+      if (!is_valid_addr (stats, stats->size))
+        fault_terminate (f);
+      struct block *block = (args[1] != 0
+                             ? block_get_by_name ((const char *) args[1])
+                             : block_get_role (BLOCK_FILESYS));
+      if (block == NULL || stats->size < 2 * sizeof (uint32_t))
+        f->eax = false;
+      else
+        {
+          block_get_stats (block, stats);
+          f->eax = true;
+        }
+    }
 }
 
 static void fault_terminate (struct intr_frame *f)